@@ -0,0 +1,297 @@
+/*
+ * microbench.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ *
+ * Microbenchmarks for the data structures on the simulation's hot paths.  Prints one line per benchmark:
+ *   name, parameter, iterations, nanoseconds per operation
+ * Blockchain, SHA-256, validation and AddrManager benchmarks are plain C++.  MessageGenerator benchmarks need the simulation kernel and are only
+ * built with BENCH_WITH_OMNETPP (see the Makefile).
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <vector>
+#include "blockchain/blockchain.h"
+#include "blockchain/merkle.h"
+#include "blockchain/sha256.h"
+#include "addr_manager.h"
+#include "validation.h"
+#include "worker_pool.h"
+#ifdef BENCH_WITH_OMNETPP
+#include <omnetpp.h>
+#include <omnetpp/cnullenvir.h>
+#include "MessageGenerator.h"
+#endif
+
+namespace {
+
+volatile int64_t sink; // results are written here so the compiler can't drop the benchmarked calls
+
+/*! Times iterations calls of op, after one untimed warm up call.
+ * \param name Name of the benchmark.
+ * \param param Size parameter (chain length, transaction count, ...) the benchmark was run with.
+ * \param iterations Number of timed calls.
+ * \param op Operation to benchmark.
+ */
+void run(const char *name, long param, long iterations, const std::function<void()> &op) {
+    op();
+    auto start = std::chrono::steady_clock::now();
+    for (long i = 0; i < iterations; ++i) {
+        op();
+    }
+    auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start);
+    std::printf("%-28s %8ld %10ld %14.1f\n", name, param, iterations, (double)elapsed.count() / iterations);
+}
+
+/*! Transaction spending numInputs outputs of the transaction before it.
+ * \param seed Distinguishes transactions, so they get different identifiers.
+ * \param numInputs Number of inputs.
+ */
+Transaction makeTx(int64_t seed, int numInputs) {
+    Transaction tx;
+    for (int i = 0; i < numInputs; ++i) {
+        tx.inputs.push_back(TransactionInput{seed - 1, i, 3});
+    }
+    tx.outputs.push_back(TransactionOutput{10, 2});
+    tx.outputs.push_back(TransactionOutput{5, 4});
+    tx.hash = tx.computeHash();
+    return tx;
+}
+
+Block makeBlock(int64_t parentHash, int height, int numTx) {
+    Block block = Block::create(0, height, 25, parentHash, height, 600);
+    for (int i = 1; i < numTx; ++i) {
+        block.addTransaction(makeTx((int64_t)height * 1000 + i, 2));
+    }
+    return block;
+}
+
+/*! Chain of length blocks of txPerBlock transactions.
+ * \param hashes If given, filled in with the hashes of the blocks, in chain order.
+ */
+std::unique_ptr<Blockchain> makeChain(long length, int txPerBlock, std::vector<int64_t> *hashes = nullptr) {
+    auto chain = Blockchain::emptyBlockchain(10);
+    int64_t parentHash = BlockHeader::NULL_HASH;
+    for (long i = 0; i < length; ++i) {
+        Block block = makeBlock(parentHash, i, txPerBlock);
+        parentHash = block.getHeader().hash;
+        if (hashes) {
+            hashes->push_back(parentHash);
+        }
+        chain->addBlock(std::move(block));
+    }
+    return chain;
+}
+
+void benchBlockchain() {
+    for (long length : {1000L, 10000L, 100000L}) {
+        auto chain = makeChain(length, 1);
+        // warm up call plus timed calls
+        std::vector<Block> next;
+        int64_t parentHash = chain->getTip().getHeader().hash;
+        for (long i = 0; i <= 1000; ++i) {
+            next.push_back(makeBlock(parentHash, length + i, 1));
+            parentHash = next.back().getHeader().hash;
+        }
+        auto nextIt = next.begin();
+        run("Blockchain::addBlock", length, 1000, [&] { sink = chain->addBlock(std::move(*nextIt++)); });
+        // same blocks on a chain pruned to its last 100 bodies
+        auto pruned = makeChain(length, 1);
+        pruned->setRetainedBlocks(100);
+        next.clear();
+        parentHash = pruned->getTip().getHeader().hash;
+        for (long i = 0; i <= 1000; ++i) {
+            next.push_back(makeBlock(parentHash, length + i, 1));
+            parentHash = next.back().getHeader().hash;
+        }
+        nextIt = next.begin();
+        run("Blockchain::addBlock pruned", length, 1000, [&] { sink = pruned->addBlock(std::move(*nextIt++)); });
+    }
+    for (long length : {1000L, 10000L}) {
+        std::vector<int64_t> hashes;
+        auto chain = makeChain(length, 1, &hashes);
+        int64_t tip = hashes.back();
+        int64_t middle = hashes[length / 2];
+        int64_t nearTip = hashes[length - 11];
+        Block known = makeBlock(hashes[length - 3], length - 2, 1);
+        run("findBlockByHash tip", length, 100, [&] { sink = chain->findBlockByHash(tip).getHeader().hash; });
+        run("findBlockByHash middle", length, 100, [&] { sink = chain->findBlockByHash(middle).getHeader().hash; });
+        run("findBlockByHash missing", length, 100, [&] { sink = chain->findBlockByHash(tip + 10).getHeader().hash; });
+        run("getBlocksAfter tip-10", length, 100, [&] { sink = chain->getBlocksAfter(nearTip).size(); });
+        run("addBlock known", length, 100, [&] { sink = chain->addBlock(Block(known)); });
+    }
+    for (int txPerBlock : {1, 100, 1000}) {
+        auto chain = makeChain(100, txPerBlock);
+        run("Block copy+serializedSize", txPerBlock, 1000, [&] {
+            Block block = chain->getTip();
+            sink = block.serializedSize();
+        });
+        run("Block build+hash", txPerBlock, 100, [&] { sink = makeBlock(1, 1, txPerBlock).getHeader().hash; });
+    }
+}
+
+/*! Compares the portable SHA-256 with the CPU specific implementations (SHA-NI for single messages, AVX2 for batches).
+ */
+void benchSha256() {
+    std::printf("# sha256 implementation: %s\n", sha256::implementation().c_str());
+    std::string header = makeBlock(1, 1, 1).getHeader().serialize();
+    for (int txPerBlock : {100, 1000, 4000}) {
+        std::vector<std::string> messages;
+        std::vector<Hash256> leaves(txPerBlock);
+        for (int i = 0; i < txPerBlock; ++i) {
+            messages.push_back(makeTx(i, 2).serialize());
+        }
+        for (bool portable : {true, false}) {
+            sha256::setPortable(portable);
+            if (txPerBlock == 100) {
+                run(portable ? "doubleHash header portable" : "doubleHash header", 1, 100000, [&] {
+                    sink = sha256::doubleHash(header.data(), header.size())[0];
+                });
+            }
+            run(portable ? "doubleHashMany tx portable" : "doubleHashMany tx", txPerBlock, 100, [&] {
+                sha256::doubleHashMany(messages, leaves.data());
+                sink = leaves[0][0];
+            });
+            run(portable ? "computeMerkleRoot portable" : "computeMerkleRoot", txPerBlock, 100, [&] {
+                sink = computeMerkleRoot(leaves)[0];
+            });
+        }
+        sha256::setPortable(false);
+        run("MerkleTree append+root", txPerBlock, 100, [&] {
+            MerkleTree tree;
+            for (const Hash256 &leaf : leaves) {
+                tree.append(leaf);
+            }
+            sink = tree.root()[0];
+        });
+        MerkleTree tree;
+        tree.append(leaves.data(), leaves.size());
+        Hash256 root = tree.root();
+        MerkleProof proof = tree.proof(txPerBlock / 2);
+        run("MerkleTree proof", txPerBlock, 10000, [&] { sink = tree.proof(txPerBlock / 2).siblings.size(); });
+        run("MerkleProof verify", txPerBlock, 10000, [&] { sink = proof.verify(leaves[txPerBlock / 2], root); });
+    }
+}
+
+void benchValidation() {
+    WorkerPool *pool = WorkerPool::acquire(0);
+    std::printf("# worker pool threads: %u\n", pool->size());
+    for (int txPerBlock : {100, 1000, 4000}) {
+        Block block = makeBlock(1, 1, txPerBlock);
+        std::vector<Transaction> mempool;
+        for (const auto &txPair : block.getTx()) {
+            // spends the first output of every transaction of the block
+            Transaction tx = makeTx(txPair.first, 0);
+            tx.inputs.push_back(TransactionInput{txPair.first, 0, txPair.second.outputs[0].publicKey + 1});
+            tx.hash = tx.computeHash();
+            mempool.push_back(tx);
+        }
+        run("checkBlock", txPerBlock, 20, [&] { sink = validation::checkBlock(block, nullptr); });
+        run("checkBlock pool", txPerBlock, 20, [&] { sink = validation::checkBlock(block, pool); });
+        run("checkTransactions", txPerBlock, 20, [&] { sink = validation::checkTransactions(mempool, block, nullptr)[0]; });
+        run("checkTransactions pool", txPerBlock, 20, [&] { sink = validation::checkTransactions(mempool, block, pool)[0]; });
+    }
+    pool->release();
+}
+
+void benchAddrManager() {
+    for (int size : {100, 1000, 10000}) {
+        AddrManager addrMan(0.25);
+        std::vector<int> addresses(size);
+        for (int i = 0; i < size; ++i) {
+            addresses[i] = i;
+        }
+        addrMan.addAddresses(addresses);
+        run("getRandomAddresses", size, 1000, [&] { sink = addrMan.getRandomAddresses().size(); });
+        run("getRandomAddresses 10", size, 1000, [&] { sink = addrMan.getRandomAddresses(10).size(); });
+    }
+}
+
+#ifdef BENCH_WITH_OMNETPP
+/*! Sets up a simulation with a do-nothing environment, as the messages need an active simulation for their creation time.
+ */
+void setUpSimulation(int argc, char **argv) {
+    omnetpp::SimTime::setScaleExp(-12);
+    auto env = new omnetpp::cNullEnvir(argc, argv, nullptr);
+    omnetpp::cSimulation::setActiveSimulation(new omnetpp::cSimulation("microbench", env));
+}
+
+void benchMessageGenerator() {
+    MessageGenerator messageGen(1);
+    for (int txPerBlock : {1, 100, 1000}) {
+        std::vector<Block> blocks{makeBlock(1, 1, txPerBlock)};
+        run("generateBlocksMessage", txPerBlock, 1000, [&] {
+            auto msg = messageGen.generateBlocksMessage(0, blocks);
+            sink = msg->getByteLength();
+            delete msg;
+        });
+        auto blocksMsg = messageGen.generateBlocksMessage(0, blocks);
+        run("BlocksMessage::dup", txPerBlock, 1000, [&] {
+            auto copy = blocksMsg->dup();
+            sink = copy->getByteLength();
+            delete copy;
+        });
+        delete blocksMsg;
+    }
+    for (int numHeaders : {1, 100, 2000}) {
+        std::vector<BlockHeader> headers(numHeaders, makeBlock(1, 1, 1).getHeader());
+        run("generateHeadersMessage", numHeaders, 1000, [&] {
+            auto msg = messageGen.generateHeadersMessage(0, headers);
+            sink = msg->getByteLength();
+            delete msg;
+        });
+    }
+    for (int numInputs : {1, 10, 100}) {
+        Transaction tx = makeTx(5, numInputs);
+        run("generateTxMessage", numInputs, 10000, [&] {
+            auto msg = messageGen.generateTxMessage(0, tx);
+            sink = msg->getByteLength();
+            delete msg;
+        });
+    }
+    for (int numAddrs : {1, 100, 1000}) {
+        std::vector<int> addrs(numAddrs, 7);
+        run("generateAddrsMessage", numAddrs, 10000, [&] {
+            auto msg = messageGen.generateAddrsMessage(0, addrs);
+            sink = msg->getByteLength();
+            delete msg;
+        });
+    }
+}
+#endif
+
+} // namespace
+
+int main(int argc, char **argv) {
+#ifdef BENCH_WITH_OMNETPP
+    omnetpp::cStaticFlag staticFlag; // must be first, see "Embedding the Simulation Kernel" in the OMNeT++ manual
+    setUpSimulation(argc, argv);
+#endif
+    // optional filter on benchmark groups: blockchain, sha256, validation, addrmanager or messagegenerator
+    const char *only = argc > 1 ? argv[1] : nullptr;
+    std::printf("%-28s %8s %10s %14s\n", "benchmark", "param", "iterations", "ns/op");
+    if (!only || std::strcmp(only, "blockchain") == 0) {
+        benchBlockchain();
+    }
+    if (!only || std::strcmp(only, "sha256") == 0) {
+        benchSha256();
+    }
+    if (!only || std::strcmp(only, "validation") == 0) {
+        benchValidation();
+    }
+    if (!only || std::strcmp(only, "addrmanager") == 0) {
+        benchAddrManager();
+    }
+#ifdef BENCH_WITH_OMNETPP
+    if (!only || std::strcmp(only, "messagegenerator") == 0) {
+        benchMessageGenerator();
+    }
+#endif
+    return EXIT_SUCCESS;
+}
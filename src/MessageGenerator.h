@@ -22,6 +22,16 @@ enum MessageScope {
     NumMessageScopes
 };
 
+/*! Message kinds, used to tell traffic apart in the eventlog and to color messages in the GUI.
+ */
+enum MessageKind {
+    ControlKind, // connection handshake and rejects
+    AddressKind,
+    BlockKind, // blocks and headers
+    TxKind,
+    SelfKind // a node's own timers
+};
+
 /*! Utility class that makes generating messages easier.
  *
  */
@@ -32,6 +42,9 @@ public:
     static constexpr const char *MESSAGE_DUMP_ADDRS = "dumpaddr";
     static constexpr const char *MESSAGE_POLL_ADDRS = "polladdrs";
     static constexpr const char *MESSAGE_MINE = "mine";
+    static constexpr const char *MESSAGE_BLOCK_FOUND = "blockfound";
+    static constexpr const char *MESSAGE_CPU_DONE = "cpudone"; // self message for when the simulated CPU finishes a message
+    static constexpr const char *MESSAGE_SYNC_TIMEOUT = "synctimeout"; // self message for the earliest sync reply deadline
     static constexpr const char *MESSAGE_NODE_VERSION_COMMAND = "nodeversion";
     static constexpr const char *MESSAGE_REJECT_COMMAND = "reject";
     static constexpr const char *MESSAGE_VERACK_COMMAND = "verack";
@@ -43,9 +56,22 @@ public:
     static constexpr const char *MESSAGE_HEADERS_COMMAND = "headers";
     static constexpr const char *MESSAGE_GETBLOCKS_COMMAND = "getblocks";
     static constexpr const char *MESSAGE_BLOCKS_COMMAND = "blocks";
+    static constexpr const char *MESSAGE_FILTERLOAD_COMMAND = "filterload"; // light node's filter, see MerkleBlock
+    static constexpr const char *MESSAGE_GETMERKLEBLOCKS_COMMAND = "getmerkleblocks";
+    static constexpr const char *MESSAGE_MERKLEBLOCKS_COMMAND = "merkleblocks";
+
+    // sizes in bytes of the BTC wire encoding, used to give messages a byte length
+    static constexpr int MESSAGE_HEADER_SIZE = 24; // magic, command, payload length and checksum
+    static constexpr int HASH_SIZE = 32;
+    static constexpr int ADDRESS_SIZE = 30; // time, services, IP address and port
+    static constexpr int PUBLIC_KEY_SIZE = 33; // compressed public key
+    static constexpr const char *USER_AGENT = "/p2p_sim:0.1/";
+    // version, services, timestamp, receiver and sender addresses without time, nonce, start height and relay flag
+    static constexpr int VERSION_FIXED_SIZE = 4 + 8 + 8 + 26 + 26 + 8 + 4 + 1;
 
     explicit MessageGenerator(int versionNo) : versionNo(versionNo) {
         initMessageScopes();
+        initMessageKinds();
     }
 
     /*! Generate a new message with the given parameter.
@@ -58,36 +84,78 @@ public:
         MessageType *result = new MessageType(std::move(command).c_str());
         result->setSource(sourceIndex);
         result->setVersionNo(versionNo);
+        result->setByteLength(MESSAGE_HEADER_SIZE);
+        auto kindIt = messageKinds.find(result->getName());
+        result->setKind(kindIt != messageKinds.end() ? kindIt->second : ControlKind);
         return result;
     }
 
     VersionMessage *generateVersionMessage(int sourceIndex, int chainHeight) {
         auto result = generateMessage<VersionMessage>(sourceIndex, MESSAGE_NODE_VERSION_COMMAND);
         result->setChainHeight(chainHeight);
+        result->addByteLength(VERSION_FIXED_SIZE + stringSize(USER_AGENT));
         return result;
     }
 
     GetHeadersMessage *generateGetHeadersMessage(int sourceIndex, int64_t hash) {
         auto result = generateMessage<GetHeadersMessage>(sourceIndex, MESSAGE_GETHEADERS_COMMAND);
         result->setHash(hash);
+        result->addByteLength(locatorSize());
         return result;
     }
 
     GetHeadersMessage *generateGetBlocksMessage(int sourceIndex, int64_t hash) {
         auto result = generateMessage<GetHeadersMessage>(sourceIndex, MESSAGE_GETBLOCKS_COMMAND);
         result->setHash(hash);
+        result->addByteLength(locatorSize());
         return result;
     }
 
     BlocksMessage *generateBlocksMessage(int sourceIndex, const std::vector<Block> blocks) {
         auto result = generateMessage<BlocksMessage>(sourceIndex, MESSAGE_BLOCKS_COMMAND);
         result->setBlocks(blocks);
+        result->addByteLength(compactSizeLength(blocks.size()));
+        for (const auto &block : blocks) {
+            result->addByteLength(block.serializedSize());
+        }
+        return result;
+    }
+
+    /*! Filtered blocks after and including the block with the given hash, for a light node.
+     *
+     */
+    GetHeadersMessage *generateGetMerkleBlocksMessage(int sourceIndex, int64_t hash) {
+        auto result = generateMessage<GetHeadersMessage>(sourceIndex, MESSAGE_GETMERKLEBLOCKS_COMMAND);
+        result->setHash(hash);
+        result->addByteLength(locatorSize());
+        return result;
+    }
+
+    MerkleBlocksMessage *generateMerkleBlocksMessage(int sourceIndex, const std::vector<MerkleBlock> &merkleBlocks) {
+        auto result = generateMessage<MerkleBlocksMessage>(sourceIndex, MESSAGE_MERKLEBLOCKS_COMMAND);
+        result->setMerkleBlocks(merkleBlocks);
+        result->addByteLength(compactSizeLength(merkleBlocks.size()));
+        for (const auto &merkleBlock : merkleBlocks) {
+            result->addByteLength(merkleBlock.serializedSize());
+        }
+        return result;
+    }
+
+    /*! Filter a light node loads into its peers, so they only send it the transactions of the given public keys.
+     * Sized as a filter holding the keys themselves, plus the number of hash functions, tweak and flags of BTC's filterload.
+     */
+    FilterLoadMessage *generateFilterLoadMessage(int sourceIndex, const std::vector<int> &publicKeys) {
+        auto result = generateMessage<FilterLoadMessage>(sourceIndex, MESSAGE_FILTERLOAD_COMMAND);
+        result->setPublicKeys(publicKeys);
+        int64_t filterSize = publicKeys.size() * PUBLIC_KEY_SIZE;
+        result->addByteLength(compactSizeLength(filterSize) + filterSize + 4 + 4 + 1);
         return result;
     }
 
     TxMessage *generateTxMessage(int sourceIndex, const Transaction &tx) {
         auto result = generateMessage<TxMessage>(sourceIndex, MESSAGE_TX_COMMAND);
         result->setTx(tx);
+        result->addByteLength(tx.serializedSize());
         return result;
     }
 
@@ -95,18 +163,23 @@ public:
         auto result = generateMessage<RejectMessage>(sourceIndex, MESSAGE_REJECT_COMMAND);
         result->setReason(reason.c_str());
         result->setDisconnect(disconnect);
+        // rejected message name (not tracked, so empty), reject code and reason
+        result->addByteLength(stringSize("") + 1 + stringSize(reason));
         return result;
     }
 
     HeadersMessage *generateHeadersMessage(int sourceIndex, const std::vector<BlockHeader> &headers) {
         auto result = generateMessage<HeadersMessage>(sourceIndex, MESSAGE_HEADERS_COMMAND);
         result->setHeaders(headers);
+        // each header is followed by a transaction count of 0
+        result->addByteLength(compactSizeLength(headers.size()) + headers.size() * (BlockHeader::SERIALIZED_SIZE + 1));
         return result;
     }
 
     AddrsMessage *generateAddrsMessage(int sourceIndex, const std::vector<int> &addrs) {
         auto result = generateMessage<AddrsMessage>(sourceIndex, MESSAGE_ADDRS_COMMAND);
         result->setAddresses(addrs);
+        result->addByteLength(compactSizeLength(addrs.size()) + addrs.size() * ADDRESS_SIZE);
         return result;
     }
 
@@ -114,6 +187,16 @@ public:
         return messageScopes.at(msgName).test(scope);
     }
 private:
+    static int64_t stringSize(const std::string &str) {
+        return compactSizeLength(str.size()) + str.size();
+    }
+
+    /*! Size of a getheaders or getblocks payload: version, a locator with one hash, and the stop hash.
+     */
+    static int64_t locatorSize() {
+        return 4 + compactSizeLength(1) + HASH_SIZE + HASH_SIZE;
+    }
+
     void initMessageScopes() {
         messageScopes.insert(std::make_pair(MESSAGE_NODE_VERSION_COMMAND, "11")); // version command first accepted command
         messageScopes.insert(std::make_pair(MESSAGE_VERACK_COMMAND, "10")); // verack accepted after version command
@@ -125,10 +208,30 @@ private:
         messageScopes.insert(std::make_pair(MESSAGE_TX_COMMAND, "00"));
         messageScopes.insert(std::make_pair(MESSAGE_GETBLOCKS_COMMAND, "00"));
         messageScopes.insert(std::make_pair(MESSAGE_BLOCKS_COMMAND, "00"));
+        messageScopes.insert(std::make_pair(MESSAGE_FILTERLOAD_COMMAND, "10")); // sent right after version, so peers know not to sync from a light node
+        messageScopes.insert(std::make_pair(MESSAGE_GETMERKLEBLOCKS_COMMAND, "00"));
+        messageScopes.insert(std::make_pair(MESSAGE_MERKLEBLOCKS_COMMAND, "00"));
+    }
+
+    void initMessageKinds() {
+        for (const char *command : {MESSAGE_CHECK_QUEUES, MESSAGE_ADVERTISE_ADDRESSES, MESSAGE_DUMP_ADDRS, MESSAGE_POLL_ADDRS,
+                MESSAGE_MINE, MESSAGE_BLOCK_FOUND, MESSAGE_CPU_DONE, MESSAGE_SYNC_TIMEOUT}) {
+            messageKinds[command] = SelfKind;
+        }
+        for (const char *command : {MESSAGE_GETADDR_COMMAND, MESSAGE_ADDRS_COMMAND, MESSAGE_ADDR_COMMAND}) {
+            messageKinds[command] = AddressKind;
+        }
+        for (const char *command : {MESSAGE_GETHEADERS_COMMAND, MESSAGE_HEADERS_COMMAND, MESSAGE_GETBLOCKS_COMMAND,
+                MESSAGE_BLOCKS_COMMAND, MESSAGE_GETMERKLEBLOCKS_COMMAND, MESSAGE_MERKLEBLOCKS_COMMAND}) {
+            messageKinds[command] = BlockKind;
+        }
+        messageKinds[MESSAGE_TX_COMMAND] = TxKind;
+        // anything else is a control message
     }
 
     int versionNo;
     std::map<std::string, std::bitset<NumMessageScopes>> messageScopes;
+    std::map<std::string, MessageKind> messageKinds;
 };
 
 #endif /* MESSAGEGENERATOR_H_ */
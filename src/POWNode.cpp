@@ -7,12 +7,17 @@
 
 #include "POWNode.h"
 #include <numeric>
+#include <cmath>
 #include <set>
 #include <fstream>
 #include <boost/filesystem.hpp>
 #include <boost/algorithm/string/predicate.hpp>
 #include "messages/messages.h"
 #include "POWScheduler.h"
+#include "pow_logging.h"
+#include "handler_profiler.h"
+#include "validation.h"
+#include "checkpoint.h"
 #include <cstring>
 
 namespace fs = boost::filesystem;
@@ -23,34 +28,89 @@ POWNode::POWNode() : messageGen(nullptr) , coins(0){
 POWNode::~POWNode() {
     // dump any outgoing or incoming messages
     for (auto &kv : peers) {
+        for (POWMessage *queued : kv.second->incomingMessages) {
+            delete queued;
+        }
         kv.second->incomingMessages.clear();
     }
+    for (auto &job : messagesInProcess) {
+        delete job.second;
+    }
 }
 
 #if(1) // initialization steps
 void POWNode::addNodeToGateMapping(int nodeIndex, cGate *gate, bool inboundValue) {
-    EV << "Mapping node " << nodeIndex << " to gate " << gate << std::endl;
+    POW_EV << "Mapping node " << nodeIndex << " to gate " << gate << std::endl;
     nodeIndexToGateMap[nodeIndex] = gate;
 
     // also setup data for node
-    peers.insert(std::make_pair(nodeIndex, std::make_unique<POWNodeData>()));
+    // a previous connection with this node may have left data behind, so always start fresh
+    peers[nodeIndex] = std::make_unique<POWNodeData>();
     peers[nodeIndex]->flags.set(Inbound, inboundValue);
-    peersProcess.push(nodeIndex);
+    peers[nodeIndex]->connectedTime = simTime();
+    peersProcess.push_back(nodeIndex);
 }
 
-void POWNode::initConnections() {
-    EV << "Initializing POWNode." << std::endl;
+bool POWNode::acceptInboundConnection() {
+    if (countConnections(true) < maxInboundConnections) {
+        return true;
+    }
+    int toEvict = selectInboundEvictionCandidate();
+    if (toEvict == -1) {
+        POW_EV << "Inbound connection slots full.  Refusing connection." << std::endl;
+        return false;
+    }
+    POW_EV << "Inbound connection slots full.  Evicting peer " << toEvict << std::endl;
+    disconnectNode(toEvict);
+    return true;
+}
+
+int POWNode::selectInboundEvictionCandidate() {
+    std::vector<int> candidates;
+    for (auto &kv : peers) {
+        if (kv.second->flags.test(Inbound) && !kv.second->flags.test(Disconnect)) {
+            candidates.push_back(kv.first);
+        }
+    }
+    if (candidates.empty() || inboundEvictionPolicy == "none") {
+        return -1;
+    }
+    if (inboundEvictionPolicy == "random") {
+        return candidates[intuniform(0, candidates.size() - 1)];
+    }
+    auto connectedBefore = [&, this](int a, int b) {
+        return this->peers[a]->connectedTime < this->peers[b]->connectedTime;
+    };
+    if (inboundEvictionPolicy == "oldest") {
+        return *std::min_element(candidates.begin(), candidates.end(), connectedBefore);
+    }
+    // evicting the youngest peer protects long lived connections, as BTC does
+    return *std::max_element(candidates.begin(), candidates.end(), connectedBefore);
+}
+
+int POWNode::countConnections(bool inbound) const {
+    return std::count_if(peers.begin(), peers.end(), [inbound](const auto &kv) {
+        return kv.second->flags.test(Inbound) == inbound && !kv.second->flags.test(Disconnect);
+    });
+}
+
+void POWNode::initConnections(bool rejoin) {
+    POW_EV << "Initializing POWNode." << std::endl;
 
     int meIndex = getIndex();
+    if (staticTopology) {
+        initStaticConnections(rejoin);
+        return;
+    }
     // only connect if we are online and we are not a default node
     if (isOnline() && std::find(defaultNodes.begin(), defaultNodes.end(), meIndex) == defaultNodes.end()) {
         for (int addr : addrMan->allAddresses()) {
             if (addr != meIndex) {
-                EV << "Attempting to connect from " << meIndex << " to " << addr << std::endl;
+                POW_EV << "Attempting to connect from " << meIndex << " to " << addr << std::endl;
                 //sprintf(path, "node[%d]", addr);
                 POWNode *toCheck = getPeerNodeByPath(addr);
                 if (!toCheck->isOnline()) {
-                    EV << "Node " << addr << " is not online.  Moving onto next node." << std::endl;
+                    POW_EV << "Node " << addr << " is not online.  Moving onto next node." << std::endl;
                 } else {
                     connectTo(addr, toCheck);
                 }
@@ -60,13 +120,55 @@ void POWNode::initConnections() {
     //delete[] path;
 }
 
+void POWNode::initStaticConnections(bool rejoin) {
+    int meIndex = getIndex();
+    for (int i = 0; i < gateSize("gate"); ++i) {
+        cGate *out = gate("gate$o", i);
+        if (!out->isConnected()) {
+            continue;
+        }
+        // the owner may be a placeholder for a node in another partition, but its index is still known
+        int otherIndex = out->getPathEndGate()->getOwnerModule()->getIndex();
+        // every node starts at once, so the lower index initiates.  a rejoining node initiates all of its connections
+        bool inbound = !rejoin && otherIndex < meIndex;
+        POW_EV << meIndex << " to " << otherIndex << " static connection type: " << (inbound ? "inbound" : "outbound") << std::endl;
+        addNodeToGateMapping(otherIndex, out, inbound);
+    }
+}
+
 void POWNode::connectTo(int otherIndex, POWNode *other) {
     int meIndex = getIndex();
     if (otherIndex == meIndex) {
         // don't connect to ourselves
         return;
     }
-    // TODO: put limit on number of gates/connections?
+    if (!other->isOnline()) {
+        POW_EV << "Node " << otherIndex << " is not online.  Not connecting." << std::endl;
+        return;
+    }
+    if (nodeIndexToGateMap.find(otherIndex) != nodeIndexToGateMap.end()) {
+        // already connected
+        return;
+    }
+    if (countConnections(false) >= maxOutboundConnections) {
+        POW_EV << "Outbound connection slots full.  Not connecting to " << otherIndex << std::endl;
+        return;
+    }
+    if (!other->acceptInboundConnection()) {
+        POW_EV << "Node " << otherIndex << " refused connection." << std::endl;
+        return;
+    }
+    linkTo(otherIndex, other);
+
+    POW_BUBBLE("Connection established with peer " + std::to_string(otherIndex));
+
+    // BTC schedules proactive address advertisements, but we are going to use a polling approach
+    // scheduleAddrAd(otherIndex);
+}
+
+void POWNode::linkTo(int otherIndex, POWNode *other) {
+    int meIndex = getIndex();
+    // gate pairs freed by disconnectNode are reused before the gate vectors are expanded
     cGate *destGateIn, *destGateOut;
     other->getOrCreateFirstUnconnectedGatePair("gate", false, true, destGateIn, destGateOut);
 
@@ -74,18 +176,12 @@ void POWNode::connectTo(int otherIndex, POWNode *other) {
     getOrCreateFirstUnconnectedGatePair("gate", false, true, srcGateIn, srcGateOut);
 
     // TODO: may want to store the connections returned by connectTo here
-    srcGateOut->connectTo(destGateIn);
-    EV << meIndex << " to " << otherIndex << " connection type: outbound" << std::endl;
+    srcGateOut->connectTo(destGateIn, createLinkChannel(other->region))->callInitialize();
+    POW_EV << meIndex << " to " << otherIndex << " connection type: outbound" << std::endl;
     addNodeToGateMapping(otherIndex, srcGateOut, false); // we are initiating
-    destGateOut->connectTo(srcGateIn);
-    EV << otherIndex << " to " << meIndex << " connection type: inbound" << std::endl;
+    destGateOut->connectTo(srcGateIn, other->createLinkChannel(region))->callInitialize();
+    POW_EV << otherIndex << " to " << meIndex << " connection type: inbound" << std::endl;
     other->addNodeToGateMapping(meIndex, destGateOut, true);
-
-    std::string bubbleMessage = "Connection established with peer " + std::to_string(otherIndex);
-    bubble(bubbleMessage.c_str());
-
-    // BTC schedules proactive address advertisements, but we are going to use a polling approach
-    // scheduleAddrAd(otherIndex);
 }
 
 void POWNode::setupMessageHandlers() {
@@ -93,8 +189,11 @@ void POWNode::setupMessageHandlers() {
     selfMessageHandlers[MessageGenerator::MESSAGE_ADVERTISE_ADDRESSES] = &POWNode::advertiseAddresses;
     selfMessageHandlers[MessageGenerator::MESSAGE_DUMP_ADDRS] = &POWNode::dumpAddresses;
     selfMessageHandlers[MessageGenerator::MESSAGE_POLL_ADDRS] = &POWNode::pollAddresses;
+    selfMessageHandlers[MessageGenerator::MESSAGE_CPU_DONE] = &POWNode::cpuDoneHandler;
+    selfMessageHandlers[MessageGenerator::MESSAGE_SYNC_TIMEOUT] = &POWNode::syncTimeoutHandler;
     if (isMiner) {
         selfMessageHandlers[MessageGenerator::MESSAGE_MINE] = &POWNode::mineHandler;
+        selfMessageHandlers[MessageGenerator::MESSAGE_BLOCK_FOUND] = &POWNode::blockFoundHandler;
     }
 
     messageHandlers[MessageGenerator::MESSAGE_NODE_VERSION_COMMAND] = &POWNode::handleNodeVersionMessage;
@@ -102,16 +201,27 @@ void POWNode::setupMessageHandlers() {
     messageHandlers[MessageGenerator::MESSAGE_REJECT_COMMAND] = &POWNode::handleRejectMessage;
     messageHandlers[MessageGenerator::MESSAGE_GETADDR_COMMAND] = &POWNode::handleGetAddrMessage;
     messageHandlers[MessageGenerator::MESSAGE_ADDRS_COMMAND] = &POWNode::handleAddrsMessage;
-    messageHandlers[MessageGenerator::MESSAGE_GETHEADERS_COMMAND] = &POWNode::handleGetHeadersMessage;
-    messageHandlers[MessageGenerator::MESSAGE_HEADERS_COMMAND] = &POWNode::handleHeadersMessage;
     messageHandlers[MessageGenerator::MESSAGE_TX_COMMAND] = &POWNode::handleTxMessage;
-    messageHandlers[MessageGenerator::MESSAGE_GETBLOCKS_COMMAND] = &POWNode::handleGetBlocksMessage;
-    messageHandlers[MessageGenerator::MESSAGE_BLOCKS_COMMAND] = &POWNode::handleBlocksMessage;
+    // light nodes also need to know which peers are light, so they don't sync from them
+    messageHandlers[MessageGenerator::MESSAGE_FILTERLOAD_COMMAND] = &POWNode::handleFilterLoadMessage;
+    if (lightNode) {
+        // light nodes never serve blocks, and only download the transactions they filter for
+        messageHandlers[MessageGenerator::MESSAGE_HEADERS_COMMAND] = &POWNode::handleLightHeadersMessage;
+        messageHandlers[MessageGenerator::MESSAGE_MERKLEBLOCKS_COMMAND] = &POWNode::handleMerkleBlocksMessage;
+    } else {
+        messageHandlers[MessageGenerator::MESSAGE_GETHEADERS_COMMAND] = &POWNode::handleGetHeadersMessage;
+        messageHandlers[MessageGenerator::MESSAGE_HEADERS_COMMAND] = &POWNode::handleHeadersMessage;
+        messageHandlers[MessageGenerator::MESSAGE_GETBLOCKS_COMMAND] = &POWNode::handleGetBlocksMessage;
+        messageHandlers[MessageGenerator::MESSAGE_BLOCKS_COMMAND] = &POWNode::handleBlocksMessage;
+        messageHandlers[MessageGenerator::MESSAGE_GETMERKLEBLOCKS_COMMAND] = &POWNode::handleGetMerkleBlocksMessage;
+    }
 
     if (isMiner) {
         simulationScheduleHandlers[POWScheduler::SCHEDULER_MESSAGE_NEW_BLOCK] = &POWNode::handleNewBlock;
     }
     simulationScheduleHandlers[POWScheduler::SCHEDULER_MESSAGE_TX] = &POWNode::handleNewTx;
+    simulationScheduleHandlers[POWScheduler::SCHEDULER_MESSAGE_NODE_LEAVE] = &POWNode::handleNodeLeave;
+    simulationScheduleHandlers[POWScheduler::SCHEDULER_MESSAGE_NODE_JOIN] = &POWNode::handleNodeJoin;
 }
 
 void POWNode::internalInitialize() {
@@ -126,11 +236,16 @@ void POWNode::internalInitialize() {
 
     // internal set up step 2a:
     // create data directory if necessary
-    EV << "Current path: " << fs::current_path().string() << std::endl;
+    POW_EV << "Current path: " << fs::current_path().string() << std::endl;
     fs::create_directory(dataDir);
     // step 2b: read peer "addresses" from this node's peers.dat
     // NOTE: this does NOT set up connections to these peers
     addrMan = std::make_unique<AddrManager>(randomAddressFraction);
+    if (!restoreFile.empty()) {
+        // the checkpoint replaces both the address file and the stored blockchain
+        restoreCheckpoint(Checkpoint::load(restoreFile));
+        return;
+    }
     readAddresses();
 
     // step 2c: load blockchain
@@ -138,20 +253,29 @@ void POWNode::internalInitialize() {
 }
 
 void POWNode::initBlockchain() {
-    EV << "Loading block chain" << std::endl;
+    if (lightNode) {
+        // a light node keeps its blockchain empty, and only stores headers
+        POW_EV << "Light node, starting with an empty header chain" << std::endl;
+        blockchain = Blockchain::emptyBlockchain(blocksPerFile);
+        headerChain = std::make_unique<HeaderChain>();
+        chainHeight = 0;
+        return;
+    }
+    POW_EV << "Loading block chain" << std::endl;
     if (newNetwork || !(blockchain = Blockchain::readFromDirectory(blocksDir))) {
         blockchain = Blockchain::emptyBlockchain(blocksPerFile);
     }
+    blockchain->setRetainedBlocks(pruneDepth);
     chainHeight = blockchain->chainHeight();
 }
 
 void POWNode::readAddresses() {
     std::vector<int> addresses;
     if (newNetwork || !fs::exists(addressesFile)) {
-        EV << "Addresses file " << addressesFile << " for node " << getIndex() << " does not exist.  Reading default nodes." << std::endl;
+        POW_EV << "Addresses file " << addressesFile << " for node " << getIndex() << " does not exist.  Reading default nodes." << std::endl;
         addresses.assign(defaultNodes.begin(), defaultNodes.end());
     } else {
-        EV << "Reading known peer addresses for node " << getIndex() << std::endl;
+        POW_EV << "Reading known peer addresses for node " << getIndex() << std::endl;
         std::ifstream fileReader(addressesFile, std::ios::in | std::ios::binary);
         if (fileReader) {
             std::string fileContents;
@@ -159,11 +283,11 @@ void POWNode::readAddresses() {
             addresses = cStringTokenizer(fileContents.c_str(), ",").asIntVector();
         }
     }
-    EV << "Addresses: ";
+    POW_EV << "Addresses: ";
     for (int addr : addresses) {
-        EV << addr << " ";
+        POW_EV << addr << " ";
     }
-    EV << std::endl;
+    POW_EV << std::endl;
     addrMan->addAddresses(addresses);
 }
 
@@ -171,6 +295,7 @@ void POWNode::readConstantParameters() {
     versionNumber = par("version").intValue();
     minAcceptedVersionNumber = par("minAcceptedVersion").intValue();
     threadScheduleInterval = par("threadScheduleInterval").intValue();
+    eventDrivenQueues = par("eventDrivenQueues").boolValue();
     maxMessageProcess = par("maxMessageProcess").intValue();
     maxAddrAd = par("maxAddrAd").intValue();
     numAddrRelay = par("numAddrRelay").intValue();
@@ -185,35 +310,167 @@ void POWNode::readConstantParameters() {
     randomAddressFraction = par("randomAddressFraction").doubleValue();
     newNetwork = par("newNetwork").boolValue();
     blocksPerFile = par("blocksPerFile").intValue();
+    pruneDepth = par("pruneDepth").intValue();
+    if (pruneDepth < 0) {
+        error("pruneDepth must be at least 0, but is %d", pruneDepth);
+    }
     auto minersList = cStringTokenizer(par("minersList").stringValue()).asIntVector();
     isMiner = std::find(minersList.begin(), minersList.end(), getIndex()) != minersList.end();
     if (isMiner) {
-        EV << "Node " << getIndex() << " marked as miner" << std::endl;
+        POW_EV << "Node " << getIndex() << " marked as miner" << std::endl;
+    }
+    lightNode = par("lightNode").boolValue();
+    if (lightNode && isMiner) {
+        error("node %d is in minersList, but light nodes can't mine", getIndex());
     }
     blockSyncRecency = par("blockSyncRecency").intValue();
+    syncTimeout = par("syncTimeout").intValue();
+    maxSyncRetries = par("maxSyncRetries").intValue();
     coinbaseOutput = par("coinbaseOutput").intValue();
+    hashrate = par("hashrate").doubleValue();
+    initialDifficulty = par("initialDifficulty").doubleValue();
+    retargetInterval = par("retargetInterval").intValue();
+    targetBlockInterval = par("targetBlockInterval").intValue();
+    staticTopology = par("staticTopology").boolValue();
+    restoreFile = par("restoreCheckpoint").stdstringValue();
+    initEventlogRecording();
+    int cpuCores = par("cpuCores").intValue();
+    if (cpuCores < 0) {
+        error("cpuCores must be at least 0, but is %d", cpuCores);
+    }
+    coreFreeTimes.assign(cpuCores, SIMTIME_ZERO);
+    cStringTokenizer costTokenizer(par("processingCosts").stringValue());
+    while (costTokenizer.hasMoreTokens()) {
+        std::string cost = costTokenizer.nextToken();
+        size_t separator = cost.find('=');
+        if (separator == std::string::npos) {
+            error("processingCosts entry %s is not of the form command=seconds", cost.c_str());
+        }
+        processingCosts[cost.substr(0, separator)] = std::stod(cost.substr(separator + 1));
+    }
+    inputValidationCost = par("inputValidationCost").doubleValue();
+    blockByteCost = par("blockByteCost").doubleValue();
+    cpuBusyTime = SIMTIME_ZERO;
+    int validationThreads = par("validationThreads").intValue();
+    if (validationThreads < 0) {
+        error("validationThreads must be at least 0, but is %d", validationThreads);
+    }
+    if (validationThreads != 1) {
+        workerPool = WorkerPool::acquire(validationThreads);
+    }
+    if (par("profileHandlers").boolValue()) {
+        profiler = HandlerProfiler::acquire(getNedTypeName(), par("profileFile").stdstringValue());
+    }
+    queueDepthSignal = registerSignal("queueDepth");
+    messagesProcessedSignal = registerSignal("messagesProcessed");
+    blockArrivalDelaySignal = registerSignal("blockArrivalDelay");
+    blockReceivedSignal = registerSignal("blockReceived");
+    orphanBlockSignal = registerSignal("orphanBlock");
+    rejectedBlockSignal = registerSignal("rejectedBlock");
+    sideBranchBlockSignal = registerSignal("sideBranchBlock");
+    reorgSignal = registerSignal("reorg");
+    txConfirmationLatencySignal = registerSignal("txConfirmationLatency");
+    bytesSentSignal = registerSignal("bytesSent");
+    bytesReceivedSignal = registerSignal("bytesReceived");
+    processingDelaySignal = registerSignal("processingDelay");
+    syncTimeoutSignal = registerSignal("syncTimeout");
+    messagesProcessed = 0;
+    region = par("region").intValue();
+    bandwidth = par("bandwidth").doubleValue();
+    latencyMatrix = cStringTokenizer(par("latencyMatrix").stringValue()).asDoubleVector();
+    numRegions = std::lround(std::sqrt(latencyMatrix.size()));
+    if (numRegions * numRegions != (int)latencyMatrix.size()) {
+        error("latencyMatrix must be square, but has %d entries", (int)latencyMatrix.size());
+    }
+    if (region < 0 || region >= numRegions) {
+        error("region %d is not covered by the %d region latencyMatrix", region, numRegions);
+    }
+    maxOutboundConnections = par("maxOutboundConnections").intValue();
+    maxInboundConnections = par("maxInboundConnections").intValue();
+    inboundEvictionPolicy = par("inboundEvictionPolicy").stdstringValue();
+    if (inboundEvictionPolicy != "none" && inboundEvictionPolicy != "youngest" &&
+            inboundEvictionPolicy != "oldest" && inboundEvictionPolicy != "random") {
+        error("unknown inbound eviction policy %s", inboundEvictionPolicy.c_str());
+    }
 
     messageGen = std::make_unique<MessageGenerator>(versionNumber);
 }
 
 void POWNode::scheduleSelfMessages() {
-    scheduleAt(simTime() + threadScheduleInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_CHECK_QUEUES));
-    scheduleAt(simTime() + dumpAddressesInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_DUMP_ADDRS));
+    if (!eventDrivenQueues) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_CHECK_QUEUES, simTime() + threadScheduleInterval);
+    }
+    scheduleSelfMessage(MessageGenerator::MESSAGE_DUMP_ADDRS, simTime() + dumpAddressesInterval);
 
     // initial address poll delayed to allow initial connections to be built up
-    scheduleAt(simTime() + 2 * threadScheduleInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_POLL_ADDRS));
+    scheduleSelfMessage(MessageGenerator::MESSAGE_POLL_ADDRS, simTime() + 2 * threadScheduleInterval);
 
     if (isMiner) {
-        scheduleAt(simTime() + threadScheduleInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_MINE));
+        scheduleSelfMessage(MessageGenerator::MESSAGE_MINE, simTime() + threadScheduleInterval);
+        scheduleNextBlock();
     }
 }
 
-void POWNode::initialize() {
-    internalInitialize();
+void POWNode::initEventlogRecording() {
+    std::string policy = par("eventlogRecording").stdstringValue();
+    bool record;
+    if (policy == "all") {
+        // leave the module-eventlog-recording setting alone
+        return;
+    } else if (policy == "none") {
+        record = false;
+    } else if (policy == "miners") {
+        record = isMiner;
+    } else if (policy == "sample") {
+        // picks every (1 / fraction)th node, so the sample is spread evenly and doesn't use up random numbers
+        double fraction = par("eventlogSampleFraction").doubleValue();
+        record = std::floor((getIndex() + 1) * fraction) > std::floor(getIndex() * fraction);
+    } else {
+        error("Unknown eventlogRecording policy %s", policy.c_str());
+    }
+    setRecordEvents(record);
+}
 
+void POWNode::scheduleSelfMessage(const char *command, simtime_t time) {
+    cancelSelfMessage(command);
+    POWMessage *msg = messageGen->generateMessage(getIndex(), command);
+    pendingSelfMessages[command] = msg;
+    scheduleAt(time, msg);
+}
+
+void POWNode::cancelSelfMessage(const char *command) {
+    auto pendingIt = pendingSelfMessages.find(command);
+    if (pendingIt != pendingSelfMessages.end()) {
+        cancelAndDelete(pendingIt->second);
+        pendingSelfMessages.erase(pendingIt);
+    }
+}
+
+void POWNode::cancelSelfMessages() {
+    for (auto &kv : pendingSelfMessages) {
+        cancelAndDelete(kv.second);
+    }
+    pendingSelfMessages.clear();
+}
+
+void POWNode::initialize(int stage) {
+    if (stage == 0) {
+        internalInitialize();
+    } else if (stage == 1) {
+        if (restoreFile.empty()) {
+            bootstrap(false);
+        } else {
+            restoreConnections();
+        }
+    } else if (stage == 2 && !restoreFile.empty()) {
+        finishRestore();
+    }
+}
+
+void POWNode::bootstrap(bool rejoin) {
     // set up step 1:
     // attempt to establish connections with the list of known nodes (default nodes if there are none)
-    initConnections();
+    initConnections(rejoin);
 
     // step 2:
     // set up self scheduled messages
@@ -222,101 +479,459 @@ void POWNode::initialize() {
 
     // step 3:
     // send node version message on outbound connections
-    auto msg = messageGen->generateVersionMessage(getIndex(), blockchain->chainHeight());
+    POW_EV << "Broadcasting node version message to outbound peers." << std::endl;
+    broadcastVersion([&, this](int peer){ return !this->peers[peer]->flags.test(Inbound); });
+}
 
-    EV << "Broadcasting node version message to outbound peers." << std::endl;
-    broadcastMessage(msg, [&, this](int peer){ return !this->peers[peer]->flags.test(Inbound); });
+void POWNode::broadcastVersion(std::function<bool(int)> predicate) {
+    broadcastMessage(messageGen->generateVersionMessage(getIndex(), chainHeight), predicate);
+    if (lightNode) {
+        // sent before our verack, so the peer knows not to sync blocks from us, and only sends the transactions paying us
+        broadcastMessage(messageGen->generateFilterLoadMessage(getIndex(), {getIndex() * 2}), predicate);
+    }
 }
 
 void POWNode::broadcastMessage(POWMessage *msg, std::function<bool(int)> predicate) {
-    EV << "Broadcasting " << msg << std::endl;
+    POW_EV << "Broadcasting " << msg << std::endl;
     int successCounter = 0;
     for (auto mapIterator = nodeIndexToGateMap.begin(); mapIterator != nodeIndexToGateMap.end(); ++mapIterator) {
         // it->first is the index of the destination node
         // it->second is the gate index to send over
         if (predicate(mapIterator->first)) {
             ++successCounter;
-            cMessage *copy = msg->dup();
-            send(copy, mapIterator->second);
+            sendOnLink(msg->dup(), mapIterator->second);
         }
     }
-    EV << msg->getName() << " message broadcasted to " << successCounter << " of " << nodeIndexToGateMap.size() << " peers." << std::endl;
+    POW_EV << msg->getName() << " message broadcasted to " << successCounter << " of " << nodeIndexToGateMap.size() << " peers." << std::endl;
     delete msg;
 }
 #endif
 
+#if(1) // checkpoints
+void POWNode::writeCheckpoint(CheckpointWriter &writer) const {
+    simtime_t now = simTime();
+    writer.write<bool>(isOnline());
+    writer.write<int32_t>(coins);
+
+    // headers without a body come first: the header chain of a light node, or the pruned start of our chain
+    auto headers = lightNode ? headerChain->getHeadersAfter(BlockHeader::NULL_HASH) : blockchain->getHeadersAfter(BlockHeader::NULL_HASH);
+    size_t numPruned = lightNode ? headers.size() : blockchain->prunedHeight();
+    writer.write<uint32_t>(numPruned);
+    for (size_t i = 0; i < numPruned; ++i) {
+        writer.writeHeader(headers[i]);
+    }
+    auto blocks = numPruned < headers.size() ? blockchain->getBlocksAfter(headers[numPruned].hash) : std::vector<Block>();
+    writer.write<uint32_t>(blocks.size());
+    for (const Block &block : blocks) {
+        writer.writeBlock(block);
+    }
+    auto addresses = addrMan->allAddresses();
+    writer.write<uint32_t>(addresses.size());
+    for (int addr : addresses) {
+        writer.write<int32_t>(addr);
+    }
+
+    writer.write<int32_t>(state.bestPeerHeight);
+    for (const auto *txs : {&state.verifiedTransactions, &state.unverifiedTransactions}) {
+        writer.write<uint32_t>(txs->size());
+        for (const Transaction &tx : *txs) {
+            writer.writeTransaction(tx);
+        }
+    }
+    writer.write<uint32_t>(state.blocksToAnnounce.size());
+    for (const BlockHeader &header : state.blocksToAnnounce) {
+        writer.writeHeader(header);
+    }
+    writer.write<uint32_t>(state.outputsSpent.size());
+    for (const auto &txOutputs : state.outputsSpent) {
+        writer.write<int64_t>(txOutputs.first);
+        writer.write<uint32_t>(txOutputs.second.size());
+        for (const auto &outputLeft : txOutputs.second) {
+            writer.write<int32_t>(outputLeft.first);
+            writer.write<int32_t>(outputLeft.second);
+        }
+    }
+    writer.write<uint32_t>(txSendTimes.size());
+    for (const auto &txTime : txSendTimes) {
+        writer.write<int64_t>(txTime.first);
+        writer.write<double>((txTime.second - now).dbl());
+    }
+
+    writer.write<uint32_t>(peers.size());
+    for (const auto &kv : peers) {
+        const POWNodeData &peer = *kv.second;
+        writer.write<int32_t>(kv.first);
+        writer.write<uint64_t>(peer.flags.to_ullong());
+        writer.write<int32_t>(peer.version);
+        writer.write<int32_t>(peer.knownHeight);
+        writer.write<int64_t>(peer.pubHash);
+        writer.write<double>((peer.connectedTime - now).dbl());
+        writer.write<int32_t>(peer.syncState);
+        writer.write<double>((peer.syncDeadline - now).dbl());
+        writer.write<int64_t>(peer.locatorDepth);
+        writer.write<int32_t>(peer.syncRetries);
+        writer.write<uint32_t>(peer.blocksToSend.size());
+        for (const Block &block : peer.blocksToSend) {
+            writer.writeBlock(block);
+        }
+        writer.write<uint32_t>(peer.merkleBlocksToSend.size());
+        for (const Block &block : peer.merkleBlocksToSend) {
+            writer.writeBlock(block);
+        }
+        writer.write<uint32_t>(peer.filter.size());
+        for (int publicKey : peer.filter) {
+            writer.write<int32_t>(publicKey);
+        }
+    }
+    writer.write<uint32_t>(pendingSelfMessages.size());
+    for (const auto &kv : pendingSelfMessages) {
+        writer.writeString(kv.first);
+        writer.write<double>((kv.second->getArrivalTime() - now).dbl());
+    }
+}
+
+void POWNode::restoreCheckpoint(const Checkpoint &checkpoint) {
+    if (!checkpoint.hasNode(getIndex())) {
+        error("checkpoint %s has no record for node %d", restoreFile.c_str(), getIndex());
+    }
+    POW_EV << "Restoring node from checkpoint taken at " << checkpoint.getTime() << "s" << std::endl;
+    CheckpointReader reader = checkpoint.nodeRecord(getIndex());
+    // times are restored relative to the start of this run, so a time before the checkpoint becomes negative
+    par("online").setBoolValue(reader.read<bool>());
+    coins = reader.read<int32_t>();
+
+    blockchain = Blockchain::emptyBlockchain(blocksPerFile);
+    blockchain->setRetainedBlocks(pruneDepth);
+    if (lightNode) {
+        headerChain = std::make_unique<HeaderChain>();
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        if (lightNode) {
+            headerChain->addHeader(reader.readHeader());
+        } else {
+            blockchain->addPrunedHeader(reader.readHeader());
+        }
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        blockchain->addBlock(reader.readBlock());
+    }
+    chainHeight = lightNode ? headerChain->chainHeight() : blockchain->chainHeight();
+    std::vector<int> addresses(reader.read<uint32_t>());
+    for (int &addr : addresses) {
+        addr = reader.read<int32_t>();
+    }
+    addrMan->addAddresses(addresses);
+
+    state.bestPeerHeight = reader.read<int32_t>();
+    for (auto *txs : {&state.verifiedTransactions, &state.unverifiedTransactions}) {
+        for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+            txs->push_back(reader.readTransaction());
+        }
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        state.blocksToAnnounce.push_back(reader.readHeader());
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        auto &outputsLeft = state.outputsSpent[reader.read<int64_t>()];
+        for (uint32_t j = reader.read<uint32_t>(); j > 0; --j) {
+            int output = reader.read<int32_t>();
+            outputsLeft[output] = reader.read<int32_t>();
+        }
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        int64_t hash = reader.read<int64_t>();
+        txSendTimes[hash] = reader.read<double>();
+    }
+
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        int index = reader.read<int32_t>();
+        auto peer = std::make_unique<POWNodeData>();
+        peer->flags = std::bitset<NumFlags>(reader.read<uint64_t>());
+        peer->version = reader.read<int32_t>();
+        peer->knownHeight = reader.read<int32_t>();
+        peer->pubHash = reader.read<int64_t>();
+        peer->connectedTime = reader.read<double>();
+        peer->syncState = (SyncState)reader.read<int32_t>();
+        peer->syncDeadline = reader.read<double>();
+        peer->locatorDepth = reader.read<int64_t>();
+        peer->syncRetries = reader.read<int32_t>();
+        for (uint32_t j = reader.read<uint32_t>(); j > 0; --j) {
+            peer->blocksToSend.push_back(reader.readBlock());
+        }
+        for (uint32_t j = reader.read<uint32_t>(); j > 0; --j) {
+            peer->merkleBlocksToSend.push_back(reader.readBlock());
+        }
+        for (uint32_t j = reader.read<uint32_t>(); j > 0; --j) {
+            peer->filter.insert(reader.read<int32_t>());
+        }
+        restoredPeers[index] = std::move(peer);
+    }
+    for (uint32_t i = reader.read<uint32_t>(); i > 0; --i) {
+        std::string command = reader.readString();
+        restoredSelfMessages[command] = reader.read<double>();
+    }
+}
+
+void POWNode::restoreConnections() {
+    if (staticTopology) {
+        // wire every static connection, finishRestore drops the ones that were down
+        initStaticConnections(false);
+        return;
+    }
+    for (const auto &kv : restoredPeers) {
+        if (!kv.second->flags.test(Inbound)) {
+            POW_EV << getIndex() << " to " << kv.first << " restored connection type: outbound" << std::endl;
+            linkTo(kv.first, getPeerNodeByPath(kv.first));
+        }
+    }
+}
+
+void POWNode::finishRestore() {
+    std::vector<int> notRestored;
+    for (auto &kv : peers) {
+        auto restored = restoredPeers.find(kv.first);
+        if (restored == restoredPeers.end()) {
+            notRestored.push_back(kv.first);
+        } else {
+            *kv.second = std::move(*restored->second);
+        }
+    }
+    for (int peer : notRestored) {
+        removePeer(peer);
+    }
+    for (const auto &kv : restoredSelfMessages) {
+        scheduleSelfMessage(kv.first.c_str(), simTime() + kv.second);
+    }
+    restoredPeers.clear();
+    restoredSelfMessages.clear();
+}
+#endif
+
 #if(1) // handle incoming self messages
 void POWNode::sendOutgoingMessages(int peerIndex) {
     auto peer = peers.find(peerIndex);
     if (peer != peers.end()) {
         if (!peer->second->flags.test(SuccessfullyConnected) || peer->second->flags.test(Disconnect)) {
-            EV << "No connection with node " << peerIndex << ".  Not sending outgoing data." << std::endl;
+            POW_EV << "No connection with node " << peerIndex << ".  Not sending outgoing data." << std::endl;
             return;
         }
-        EV << "Checking for block sync with peer " << peerIndex << std::endl;
-        startBlockSync(peerIndex);
         if (!peer->second->blocksToSend.empty()) {
-            EV << peerIndex << " has requested blocks.  Sending them." << std::endl;
+            POW_EV << peerIndex << " has requested blocks.  Sending them." << std::endl;
             sendToNode(messageGen->generateBlocksMessage(getIndex(), peer->second->blocksToSend), peerIndex);
             peer->second->blocksToSend.clear();
         }
+        if (!peer->second->merkleBlocksToSend.empty()) {
+            POW_EV << peerIndex << " has requested filtered blocks.  Sending them." << std::endl;
+            std::vector<MerkleBlock> merkleBlocks;
+            merkleBlocks.reserve(peer->second->merkleBlocksToSend.size());
+            for (const Block &block : peer->second->merkleBlocksToSend) {
+                merkleBlocks.push_back(block.filter(peer->second->filter));
+            }
+            sendToNode(messageGen->generateMerkleBlocksMessage(getIndex(), merkleBlocks), peerIndex);
+            peer->second->merkleBlocksToSend.clear();
+        }
     } else {
-        EV << "Attempted to send data to nonexistant node " << peerIndex << std::endl;
+        POW_EV << "Attempted to send data to nonexistant node " << peerIndex << std::endl;
     }
 }
 
+BlockHeader POWNode::tipHeader() const {
+    const HeaderChain &headers = activeHeaders();
+    return headers.chainHeight() > 0 ? headers.getTip() : BlockHeader();
+}
+
+const HeaderChain &POWNode::activeHeaders() const {
+    return lightNode ? *headerChain : blockchain->getHeaders();
+}
+
+int64_t POWNode::locatorHash(long depth) const {
+    const HeaderChain &headers = activeHeaders();
+    long height = (long)headers.chainHeight() - 1 - depth;
+    return height >= 0 ? headers.at(height).hash : BlockHeader::NULL_HASH;
+}
+
 void POWNode::startBlockSync(int peerIndex) {
-    if (!state.syncStarted) {
-        EV << "Starting block sync with peer " << peerIndex << std::endl;
-        // request headers from a single peer, unless our best header is recent enough
-        Block best;
-        if (blockchain->chainHeight() > 0) {
-            best = blockchain->getTip();
-        }
-        if (state.numSyncs == 0 || best.getHeader().creationTime > simTime().inUnit(SimTimeUnit::SIMTIME_S) - blockSyncRecency) {
-            state.syncStarted = true;
-            state.numSyncs++;
-            int64_t bestHash = BlockHeader::NULL_HASH;
-            if (best.getHeader().hash != BlockHeader::NULL_HASH) {
-                bestHash = best.getHeader().hash;
-                int64_t parent = best.getHeader().parentHash;
-                if (parent != BlockHeader::NULL_HASH) {
-                    bestHash = parent;
-                }
+    auto &peer = peers[peerIndex];
+    if (peer->flags.test(FilterLoaded) || peer->syncState != SyncIdle) {
+        return;
+    }
+    // request headers from a single peer, unless the peer has the longest chain or our best header is recent enough
+    bool longest = peer->knownHeight > chainHeight && peer->knownHeight == state.bestPeerHeight;
+    if (countSyncing() == 0 || longest || tipHeader().creationTime > simTime().inUnit(SimTimeUnit::SIMTIME_S) - blockSyncRecency) {
+        POW_EV << "Starting block sync with peer " << peerIndex << std::endl;
+        requestHeaders(peerIndex);
+    }
+}
+
+void POWNode::requestHeaders(int peerIndex, long depth) {
+    // the peer only answers if the block is on its chain, so start before our tip in case the peer has a competing tip
+    sendToNode(messageGen->generateGetHeadersMessage(getIndex(), locatorHash(depth)), peerIndex);
+    auto &peer = peers[peerIndex];
+    peer->locatorDepth = depth;
+    peer->syncState = SyncHeadersRequested;
+    peer->syncDeadline = simTime() + syncTimeout;
+    rescheduleSyncTimeout();
+}
+
+void POWNode::requestBlocks(int peerIndex, int64_t hash) {
+    if (lightNode) {
+        sendToNode(messageGen->generateGetMerkleBlocksMessage(getIndex(), hash), peerIndex);
+    } else {
+        sendToNode(messageGen->generateGetBlocksMessage(getIndex(), hash), peerIndex);
+    }
+    auto &peer = peers[peerIndex];
+    // the peer answered
+    peer->syncRetries = 0;
+    peer->syncState = SyncBlocksInFlight;
+    peer->syncDeadline = simTime() + syncTimeout;
+    rescheduleSyncTimeout();
+}
+
+void POWNode::handleUnconnectedHeaders(int peerIndex) {
+    auto &peer = peers[peerIndex];
+    if (peer->syncState == SyncHeadersRequested) {
+        if (locatorHash(peer->locatorDepth) == BlockHeader::NULL_HASH) {
+            // we asked for the peer's whole chain.  it doesn't share our first block
+            POW_EV_WARN << "Chain of peer " << peerIndex << " doesn't connect to ours" << std::endl;
+            finishSyncStep(peerIndex, SyncHeadersRequested);
+        } else {
+            POW_EV << "Chain of peer " << peerIndex << " forked from ours further back.  Requesting headers from " <<
+                    2 * peer->locatorDepth << " blocks before our tip" << std::endl;
+            requestHeaders(peerIndex, 2 * peer->locatorDepth);
+        }
+    } else if (peer->syncState != SyncBlocksInFlight) {
+        // we missed some blocks.  ask the peer for the headers after our tip
+        POW_EV << "Could not connect new block to our blockchain.  Requesting headers from " << peerIndex << std::endl;
+        requestHeaders(peerIndex);
+    }
+}
+
+void POWNode::finishSyncStep(int peerIndex, SyncState expected) {
+    auto &peer = peers[peerIndex];
+    if (peer->syncState == expected) {
+        POW_EV << "Synced with peer " << peerIndex << std::endl;
+        peer->syncState = SyncSynced;
+        peer->syncRetries = 0;
+        rescheduleSyncTimeout();
+    }
+}
+
+void POWNode::syncTimeoutHandler(POWMessage *msg) {
+    std::vector<int> stalled;
+    std::vector<int> retries;
+    for (const auto &kv : peers) {
+        SyncState syncState = kv.second->syncState;
+        if (kv.second->syncDeadline > simTime()) {
+            continue;
+        }
+        if (syncState == SyncHeadersRequested || syncState == SyncBlocksInFlight) {
+            stalled.push_back(kv.first);
+        } else if (syncState == SyncBackoff) {
+            retries.push_back(kv.first);
+        }
+    }
+    for (int peerIndex : retries) {
+        auto &peer = peers[peerIndex];
+        if (countSyncing() > 0) {
+            // another peer came along while we waited
+            peer->syncState = SyncIdle;
+            peer->syncRetries = 0;
+        } else {
+            POW_EV << "Retrying block sync with peer " << peerIndex << " (retry " << peer->syncRetries << ")" << std::endl;
+            requestHeaders(peerIndex);
+        }
+    }
+    for (int peerIndex : stalled) {
+        if (peers.find(peerIndex) == peers.end()) {
+            // disconnected by an earlier retry
+            continue;
+        }
+        POW_EV_WARN << "Peer " << peerIndex << " did not answer our sync request in time" << std::endl;
+        emit(syncTimeoutSignal, (long)peerIndex);
+        auto &stalledPeer = peers[peerIndex];
+        stalledPeer->syncState = SyncIdle;
+        // sync from the connected full peer with the longest chain instead
+        int replacement = -1;
+        for (const auto &kv : peers) {
+            const POWNodeData &peer = *kv.second;
+            if (kv.first != peerIndex && peer.flags.test(SuccessfullyConnected) && !peer.flags.test(Disconnect) &&
+                    !peer.flags.test(FilterLoaded) && (peer.syncState == SyncIdle || peer.syncState == SyncSynced) &&
+                    (replacement < 0 || peer.knownHeight > peers[replacement]->knownHeight)) {
+                replacement = kv.first;
             }
-            sendToNode(messageGen->generateGetHeadersMessage(getIndex(), bestHash), peerIndex);
         }
+        if (replacement >= 0) {
+            POW_EV << "Requesting headers from peer " << replacement << " instead" << std::endl;
+            stalledPeer->syncRetries = 0;
+            requestHeaders(replacement);
+        } else if (stalledPeer->syncRetries < maxSyncRetries) {
+            // no other peer to sync from.  try the same one again, waiting twice as long each time
+            simtime_t backoff = syncTimeout * (double)(1 << stalledPeer->syncRetries);
+            ++stalledPeer->syncRetries;
+            POW_EV << "No other peer to sync from.  Retrying peer " << peerIndex << " in " << backoff << std::endl;
+            stalledPeer->syncState = SyncBackoff;
+            stalledPeer->syncDeadline = simTime() + backoff;
+        } else {
+            POW_EV_WARN << "Peer " << peerIndex << " did not answer " << maxSyncRetries << " sync retries.  Disconnecting it" << std::endl;
+            disconnectNode(peerIndex);
+        }
+    }
+    rescheduleSyncTimeout();
+}
+
+void POWNode::rescheduleSyncTimeout() {
+    bool waiting = false;
+    simtime_t earliest;
+    for (const auto &kv : peers) {
+        SyncState syncState = kv.second->syncState;
+        bool pending = syncState == SyncHeadersRequested || syncState == SyncBlocksInFlight || syncState == SyncBackoff;
+        if (pending && (!waiting || kv.second->syncDeadline < earliest)) {
+            waiting = true;
+            earliest = kv.second->syncDeadline;
+        }
+    }
+    if (!waiting) {
+        cancelSelfMessage(MessageGenerator::MESSAGE_SYNC_TIMEOUT);
+        return;
+    }
+    auto pending = pendingSelfMessages.find(MessageGenerator::MESSAGE_SYNC_TIMEOUT);
+    if (pending == pendingSelfMessages.end() || pending->second->getArrivalTime() != earliest) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_SYNC_TIMEOUT, earliest);
     }
 }
 
+int POWNode::countSyncing() const {
+    return std::count_if(peers.begin(), peers.end(), [](const std::pair<const int, std::unique_ptr<POWNodeData>> &kv) {
+        return kv.second->syncState == SyncHeadersRequested || kv.second->syncState == SyncBlocksInFlight;
+    });
+}
+
 void POWNode::mineHandler(POWMessage *msg) {
     if (isMiner) {
-        EV << "Handling mine message" << std::endl;
+        POW_EV << "Handling mine message" << std::endl;
         // proof of work is handled by the scheduler
         // all we need to do is validate transactions
         if (blockchain->chainHeight() > 0) {
             size_t numTransactions = state.unverifiedTransactions.size();
             if (numTransactions > 0) {
-                EV << "Attempting to validate " << numTransactions << " transactions." << std::endl;
-                for (auto tx : state.unverifiedTransactions) {
-                    if (std::all_of(tx.inputs.begin(), tx.inputs.end(), [&, this](TransactionInput in) {
-                        return this->blockchain->getTip().getTx()[in.prevTxHash].outputs[in.prevTxN].publicKey ==
-                                in.signature - 1; // TODO: for now don't check for double spends
-                    })) {
-                        EV_DETAIL << "Transaction valid" << std::endl;
-                        state.verifiedTransactions.push_back(tx);
+                POW_EV << "Attempting to validate " << numTransactions << " transactions." << std::endl;
+                auto valid = validation::checkTransactions(state.unverifiedTransactions, blockchain->getTip(), workerPool);
+                for (size_t i = 0; i < numTransactions; ++i) {
+                    if (valid[i]) {
+                        POW_EV_DETAIL << "Transaction valid" << std::endl;
+                        state.verifiedTransactions.push_back(state.unverifiedTransactions[i]);
                     } else {
-                        EV_DETAIL << "Transaction invalid" << std::endl;
+                        POW_EV_DETAIL << "Transaction invalid" << std::endl;
                     }
                 }
                 state.unverifiedTransactions.clear();
             } else {
-                EV << "No transactions to validate." << std::endl;
+                POW_EV << "No transactions to validate." << std::endl;
             }
         } else {
-            EV << "Don't have any blocks yet.  Waiting to validate transactions." << std::endl;
+            POW_EV << "Don't have any blocks yet.  Waiting to validate transactions." << std::endl;
         }
-        scheduleAt(simTime() + threadScheduleInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_MINE));
+        scheduleSelfMessage(MessageGenerator::MESSAGE_MINE, simTime() + threadScheduleInterval);
     }
 }
 
@@ -324,64 +939,137 @@ void POWNode::processMessage(POWMessage *msg) {
     std::string methodName = msg->getName();
     auto mapIt = messageHandlers.find(methodName);
     if (mapIt != messageHandlers.end()) {
-        EV << "Processing message " << msg << std::endl;
+        ProfileScope profile(profiler, msg->getName());
+        POW_EV << "Processing message " << msg << std::endl;
         if (checkMessageInScope(msg)) {
-            EV <<  "Message in scope." << std::endl;
+            POW_EV <<  "Message in scope." << std::endl;
             mapIt->second(*this, msg);
         } else {
-            EV << "Message not in scope." << std::endl;
+            POW_EV << "Message not in scope." << std::endl;
             // TODO: mark misbehaving
         }
     } else {
-        EV << "Handler not found for message of type " << methodName << std::endl;
+        POW_EV << "Handler not found for message of type " << methodName << std::endl;
     }
+    emit(processingDelaySignal, simTime() - msg->getArrivalTime());
     delete msg;
 }
 
+bool POWNode::coreIdle() const {
+    return coreFreeTimes.empty() || *std::min_element(coreFreeTimes.begin(), coreFreeTimes.end()) <= simTime();
+}
+
+simtime_t POWNode::processingCost(POWMessage *msg) const {
+    auto costIt = processingCosts.find(msg->getName());
+    simtime_t cost = costIt != processingCosts.end() ? costIt->second : SIMTIME_ZERO;
+    if (BlocksMessage *blMsg = dynamic_cast<BlocksMessage*>(msg)) {
+        for (const Block &block : blMsg->getBlocks()) {
+            cost += inputValidationCost * (double)block.numInputs() + blockByteCost * (double)block.serializedSize();
+        }
+    } else if (MerkleBlocksMessage *merkleMsg = dynamic_cast<MerkleBlocksMessage*>(msg)) {
+        for (const MerkleBlock &merkleBlock : merkleMsg->getMerkleBlocks()) {
+            cost += blockByteCost * (double)merkleBlock.serializedSize();
+        }
+    } else if (TxMessage *txMsg = dynamic_cast<TxMessage*>(msg)) {
+        cost += inputValidationCost * (double)txMsg->getTx().inputs.size();
+    }
+    return cost;
+}
+
+void POWNode::startProcessing(POWMessage *msg) {
+    if (coreFreeTimes.empty()) {
+        processMessage(msg);
+        return;
+    }
+    simtime_t cost = processingCost(msg);
+    if (cost == SIMTIME_ZERO) {
+        processMessage(msg);
+        return;
+    }
+    // the core idle the longest.  coreIdle was checked, so it is free now
+    auto core = std::min_element(coreFreeTimes.begin(), coreFreeTimes.end());
+    *core = simTime() + cost;
+    cpuBusyTime += cost;
+    POW_EV_DETAIL << "Processing " << msg << " until " << *core << std::endl;
+    auto job = messagesInProcess.emplace(*core, msg);
+    if (job == messagesInProcess.begin()) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_CPU_DONE, job->first);
+    }
+}
+
+void POWNode::cpuDoneHandler(POWMessage *msg) {
+    // messages finishing at the same time are handled in the order they were started
+    while (!messagesInProcess.empty() && messagesInProcess.begin()->first <= simTime()) {
+        POWMessage *done = messagesInProcess.begin()->second;
+        messagesInProcess.erase(messagesInProcess.begin());
+        auto peer = peers.find(done->getSource());
+        if (peer == peers.end() || peer->second->flags.test(Disconnect)) {
+            POW_EV << "Dropping processed message from disconnected peer " << done->getSource() << std::endl;
+            delete done;
+        } else {
+            int source = done->getSource();
+            processMessage(done);
+            // send the reply (e.g. requested blocks) now, rather than when the queues are next checked
+            sendOutgoingMessages(source);
+        }
+    }
+    if (!messagesInProcess.empty()) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_CPU_DONE, messagesInProcess.begin()->first);
+    }
+    if (queuedMessages() || outgoingData()) {
+        wakeQueues();
+    }
+}
+
 bool POWNode::processIncomingMessages(int peerIndex) {
     // TODO: check a received data buffer for this index and calls processGetData if it's not empty
     auto peer = peers.find(peerIndex);
     bool moreWork = false;
     if (peer != peers.end()) {
         if (peer->second->flags.test(Disconnect)) {
-            EV << "Node " << peerIndex << " scheduled for disconnect.  Not processing incoming message." << std::endl;
+            POW_EV << "Node " << peerIndex << " scheduled for disconnect.  Not processing incoming message." << std::endl;
             return false;
         }
         // TODO: check the received data buffer again here, and return true if it is not empty
         if (peer->second->flags.test(PauseSend)) {
-            EV << "Send buffer for node " << peerIndex << " is full.  Not processing incoming message." << std::endl;
+            POW_EV << "Send buffer for node " << peerIndex << " is full.  Not processing incoming message." << std::endl;
             return false;
         }
 
         if (peer->second->incomingMessages.empty()) {
-            EV << "No messages to process for node " << peerIndex << std::endl;
+            POW_EV << "No messages to process for node " << peerIndex << std::endl;
             return false;
         }
+        if (!coreIdle()) {
+            POW_EV << "All cores are busy.  Not processing incoming message from node " << peerIndex << std::endl;
+            return true;
+        }
         POWMessage *msg = peer->second->incomingMessages.front();
         peer->second->incomingMessages.pop_front();
         peer->second->flags[PauseReceive] = 0; // TODO: set if the queue size is greater than receiveFloodSize
         moreWork = !peer->second->incomingMessages.empty();
 
         // TODO: check checksum here
-        processMessage(msg);
+        ++messagesProcessed;
+        startProcessing(msg);
 
         // TODO: check received data buffer (again) here
 
         // TODO: send reject messages and check for banned peers
     } else {
-        EV << "Attempted to process messages for nonexistant node " << peerIndex << std::endl;
+        POW_EV << "Attempted to process messages for nonexistant node " << peerIndex << std::endl;
     }
     return moreWork;
 }
 
 void POWNode::pollAddresses(POWMessage *msg) {
     int meIndex = getIndex();
-    EV << "Polling successfully connected peers for connections." << std::endl;
+    POW_EV << "Polling successfully connected peers for connections." << std::endl;
     broadcastMessage(messageGen->generateMessage(meIndex, MessageGenerator::MESSAGE_GETADDR_COMMAND),
             [&, this](int peer){ return this->peers[peer]->flags.test(SuccessfullyConnected); });
     simtime_t next = simTime() + threadScheduleInterval;
     if (next < stopAddrPollingTime) {
-        scheduleAt(next, messageGen->generateMessage(meIndex, MessageGenerator::MESSAGE_POLL_ADDRS));
+        scheduleSelfMessage(MessageGenerator::MESSAGE_POLL_ADDRS, next);
     }
 }
 
@@ -394,14 +1082,14 @@ void POWNode::scheduleAddrAd(int peerIndex) {
 void POWNode::advertiseAddresses(POWMessage *msg) {
     /*
     // data is form peerIndex=<index>
-    EV << "Performing scheduled address advertisement.  Message that triggered this: " << msg->getFullName() << std::endl;
-    EV_DETAIL << "Message data: " << msg->getData() << std::endl;
+    POW_EV << "Performing scheduled address advertisement.  Message that triggered this: " << msg->getFullName() << std::endl;
+    POW_EV_DETAIL << "Message data: " << msg->getData() << std::endl;
     std::map<std::string, std::string> messageData = dataToMap(msg->getData());
     std::string peerIndexStr = messageData["peerIndex"];
-    EV_DETAIL << "Target peer: \"" << peerIndexStr << "\"" << std::endl;
+    POW_EV_DETAIL << "Target peer: \"" << peerIndexStr << "\"" << std::endl;
     int adTarget = std::stoi(messageData["peerIndex"]);
     if (!peers[adTarget]->flags.test(SuccessfullyConnected) || peers[adTarget]->flags.test(Disconnect)) {
-        EV << "Peer " << adTarget << " disconnected.  Not advertising addresses." << std::endl;
+        POW_EV << "Peer " << adTarget << " disconnected.  Not advertising addresses." << std::endl;
     } else {
         scheduleAddrAd(adTarget);
         auto peer = peers.find(adTarget);
@@ -415,8 +1103,8 @@ void POWNode::advertiseAddresses(POWMessage *msg) {
                         std::string data = "addresses=";
                         data += std::accumulate(addresses.begin() + 1, addresses.end(), std::to_string(addresses[0]),
                                 [](const std::string &a, int b) { return a + "," + std::to_string(b); });
-                        EV << "Advertising " << addresses.size() << " to peer " << adTarget << std::endl;
-                        EV_DETAIL << "Advertisement contents: " << vectorAsString(addresses) << std::endl;
+                        POW_EV << "Advertising " << addresses.size() << " to peer " << adTarget << std::endl;
+                        POW_EV_DETAIL << "Advertisement contents: " << vectorAsString(addresses) << std::endl;
                         sendToNode(messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_ADDR_COMMAND, data), adTarget);
                         addresses.clear();
                     }
@@ -424,15 +1112,15 @@ void POWNode::advertiseAddresses(POWMessage *msg) {
             }
             peer->second->addressesToBeSent.clear();
             if (!addresses.empty()) {
-                EV << "Advertising " << addresses.size() << " to peer " << adTarget << std::endl;
-                EV_DETAIL << "Advertisement contents: " << vectorAsString(addresses) << std::endl;
+                POW_EV << "Advertising " << addresses.size() << " to peer " << adTarget << std::endl;
+                POW_EV_DETAIL << "Advertisement contents: " << vectorAsString(addresses) << std::endl;
                 std::string data = "addresses=";
                 data += std::accumulate(addresses.begin() + 1, addresses.end(), std::to_string(addresses[0]),
                         [](const std::string &a, int b) { return a + "," + std::to_string(b); });
                 sendToNode(messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_ADDR_COMMAND, data), adTarget);
             }
         } else {
-            EV << "Cannot advertise to nonexistant peer " << adTarget << std::endl;
+            POW_EV << "Cannot advertise to nonexistant peer " << adTarget << std::endl;
         }
     }
     scheduleAddrAd(adTarget);
@@ -442,27 +1130,61 @@ void POWNode::advertiseAddresses(POWMessage *msg) {
 void POWNode::messageHandler(POWMessage *msg) {
     // only process a certain number of messages at once
     // need to ensure that each node gets a fair chance at being processed
-    EV << "Handling messages in node " << getIndex() << std::endl;
-    for (currentMessagesProcessed = 0; currentMessagesProcessed < maxMessageProcess; ++currentMessagesProcessed) {
+    POW_EV << "Handling messages in node " << getIndex() << std::endl;
+    for (currentMessagesProcessed = 0; currentMessagesProcessed < maxMessageProcess && !peersProcess.empty(); ++currentMessagesProcessed) {
         int peerIndex = peersProcess.front();
-        peersProcess.pop();
-        EV << "Processing and sending messages for node " << peerIndex << std::endl;
-        auto peerIt = peers.find(peerIndex);
-        if (!peerIt->second->flags.test(Disconnect)) {
-            processIncomingMessages(peerIndex);
+        peersProcess.pop_front();
+        POW_EV << "Processing and sending messages for node " << peerIndex << std::endl;
+        processIncomingMessages(peerIndex);
+        // processing may have disconnected the peer
+        if (peers.find(peerIndex) != peers.end()) {
             sendOutgoingMessages(peerIndex);
-            peersProcess.push(peerIndex);
+            peersProcess.push_back(peerIndex);
         } // don't put the peer back on if it's disconnected
     }
+    emit(messagesProcessedSignal, messagesProcessed);
+    messagesProcessed = 0;
     // do broadcasts
     sendBroadcasts();
-    scheduleAt(simTime() + threadScheduleInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_CHECK_QUEUES));
+    if (!eventDrivenQueues) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_CHECK_QUEUES, simTime() + threadScheduleInterval);
+    } else if (queuedMessages() || outgoingData()) {
+        // the rest of the messages are processed in another event, after the other events at this time
+        wakeQueues();
+    }
+}
+
+void POWNode::wakeQueues() {
+    if (!eventDrivenQueues || (!coreIdle() && !outgoingData())) {
+        // busy cores wake the queues once they are done.  data to send doesn't wait for them
+        return;
+    }
+    // a pending check already covers the new work
+    if (pendingSelfMessages.find(MessageGenerator::MESSAGE_CHECK_QUEUES) == pendingSelfMessages.end()) {
+        scheduleSelfMessage(MessageGenerator::MESSAGE_CHECK_QUEUES, simTime());
+    }
+}
+
+bool POWNode::outgoingData() const {
+    if (!state.blocksToAnnounce.empty()) {
+        return true;
+    }
+    return std::any_of(peers.begin(), peers.end(), [](const std::pair<const int, std::unique_ptr<POWNodeData>> &kv) {
+        return (!kv.second->blocksToSend.empty() || !kv.second->merkleBlocksToSend.empty()) &&
+                kv.second->flags.test(SuccessfullyConnected) && !kv.second->flags.test(Disconnect);
+    });
+}
+
+bool POWNode::queuedMessages() const {
+    return std::any_of(peers.begin(), peers.end(), [](const std::pair<const int, std::unique_ptr<POWNodeData>> &kv) {
+        return !kv.second->incomingMessages.empty() && !kv.second->flags.test(Disconnect) && !kv.second->flags.test(PauseSend);
+    });
 }
 
 void POWNode::sendBroadcasts() {
     // for now this is just block announcements
     if (!state.blocksToAnnounce.empty()) {
-        EV << "Broadcasting initial block announcement." << std::endl;
+        POW_EV << "Broadcasting initial block announcement." << std::endl;
         broadcastMessage(messageGen->generateHeadersMessage(getIndex(), state.blocksToAnnounce),
                 [&,this](int peerIndex) {
             return this->peers[peerIndex]->flags.test(SuccessfullyConnected) && !this->peers[peerIndex]->flags.test(Disconnect);
@@ -475,21 +1197,22 @@ void POWNode::handleSelfMessage(POWMessage *msg) {
     std::string methodName = msg->getName();
     auto handlerIt = selfMessageHandlers.find(methodName);
     if (handlerIt != selfMessageHandlers.end()) {
+        ProfileScope profile(profiler, msg->getName());
         handlerIt->second(*this, msg);
     } else {
-        EV << "No handler for self message " << msg << std::endl;
+        POW_EV << "No handler for self message " << msg << std::endl;
     }
 }
 
 void POWNode::dumpAddresses(POWMessage *msg) {
     // probably could optimize to just write new addresses but that's complicated
     // TODO: determine if we need to do banlist stuff
-    EV << "Dumping known addresses for node " << getIndex() << std::endl;
+    POW_EV << "Dumping known addresses for node " << getIndex() << std::endl;
     std::ofstream fileWriter(addressesFile, std::ios::out | std::ios::trunc);
     if (fileWriter) {
-        EV << "File opened for writing successfully" << std::endl;
+        POW_EV << "File opened for writing successfully" << std::endl;
         auto addrs = addrMan->allAddresses();
-        EV << "Writing " << addrs.size() << " to file." << std::endl;
+        POW_EV << "Writing " << addrs.size() << " to file." << std::endl;
         int i = 0;
         for (auto it = addrs.begin(); it != addrs.end(); ++it) {
             fileWriter << std::to_string(*it);
@@ -500,9 +1223,9 @@ void POWNode::dumpAddresses(POWMessage *msg) {
         fileWriter.flush();
         fileWriter.close();
     } else {
-        EV << "Data file could not be written to." << std::endl;
+        POW_EV << "Data file could not be written to." << std::endl;
     }
-    scheduleAt(simTime() + dumpAddressesInterval, messageGen->generateMessage(getIndex(), MessageGenerator::MESSAGE_DUMP_ADDRS));
+    scheduleSelfMessage(MessageGenerator::MESSAGE_DUMP_ADDRS, simTime() + dumpAddressesInterval);
 }
 #endif
 
@@ -512,47 +1235,109 @@ void POWNode::handleMessage(cMessage *msg) {
     std::string test = "schedule";
     if (strncmp(msgName.c_str(), test.c_str(), strlen(test.c_str())) == 0) {
         SchedulerMessage *schMessage = check_and_cast<SchedulerMessage*>(msg);
-        EV << "Received simulation scheduler message " << schMessage << std::endl;
+        POW_EV << "Received simulation scheduler message " << schMessage << std::endl;
         handleScheduledMessage(schMessage);
         delete msg;
     } else {
         POWMessage *powMessage = check_and_cast<POWMessage *>(msg);
         logReceivedMessage(powMessage);
         if (powMessage->isSelfMessage()) {
-            EV << "Received self scheduler message.  Sending to appropriate handler." << std::endl;
+            POW_EV << "Received self scheduler message.  Sending to appropriate handler." << std::endl;
+            pendingSelfMessages.erase(powMessage->getName());
             handleSelfMessage(powMessage);
             delete msg;
+        } else if (!isOnline()) {
+            // a node that left the network neither accepts connections nor answers messages still in flight to it
+            POW_EV << "Node is offline.  Dropping message from peer " << powMessage->getSource() << std::endl;
+            delete msg;
         } else {
+            bytesReceivedByType[msgName] += powMessage->getByteLength();
+            emit(bytesReceivedSignal, powMessage->getByteLength());
             int source = powMessage->getSource();
-            EV << "Adding message to queue for peer " << source << std::endl;
-            peers[source]->incomingMessages.push_back(powMessage);
-            // don't delete here because the message needs to be processed
+            auto peer = peers.find(source);
+            if (peer == peers.end() && staticTopology && msgName == MessageGenerator::MESSAGE_NODE_VERSION_COMMAND) {
+                // a peer on one of our static connections that rejoined the network
+                POW_EV << "Accepting reconnection from static peer " << source << std::endl;
+                addNodeToGateMapping(source, gate("gate$o", powMessage->getArrivalGate()->getIndex()), true);
+                peer = peers.find(source);
+            }
+            if (peer == peers.end() || peer->second->flags.test(Disconnect)) {
+                // message was already in flight when the connection was torn down
+                POW_EV << "Dropping message from disconnected peer " << source << std::endl;
+                delete msg;
+            } else {
+                POW_EV << "Adding message to queue for peer " << source << std::endl;
+                peer->second->incomingMessages.push_back(powMessage);
+                emit(queueDepthSignal, (long)peer->second->incomingMessages.size());
+                if (peer->second->incomingMessages.size() == 1) {
+                    wakeQueues();
+                }
+                // don't delete here because the message needs to be processed
+            }
         }
     }
 }
 
 void POWNode::handleBlocksMessage(POWMessage *msg) {
-    EV << "Handling blocks message " << msg << std::endl;
+    POW_EV << "Handling blocks message " << msg << std::endl;
     if (isMiner) {
         state.verifiedTransactions.clear();
     }
     BlocksMessage *blMsg = check_and_cast<BlocksMessage*>(msg);
-    EV << "Received " << blMsg->getBlocks().size() << " blocks from peer " << blMsg->getSource() << std::endl;
+    POW_EV << "Received " << blMsg->getBlocks().size() << " blocks from peer " << blMsg->getSource() << std::endl;
+    int64_t oldTip = tipHeader().hash;
     for (auto bl : blMsg->getBlocks()) {
-        blockchain->addBlock(std::move(bl));
+        simtime_t arrivalDelay = simTime() - bl.getHeader().creationTime;
+        int64_t hash = bl.getHeader().hash;
+        if (!blockchain->contains(hash) && !validation::checkBlock(bl, workerPool)) {
+            POW_EV_WARN << "Block " << hash << " from peer " << blMsg->getSource() << " doesn't match its header" << std::endl;
+            emit(rejectedBlockSignal, 1);
+            continue;
+        }
+        TipChange change;
+        switch (blockchain->addBlock(std::move(bl), &change)) {
+        case BlockAdded:
+            emit(blockArrivalDelaySignal, arrivalDelay);
+            emit(blockReceivedSignal, (long)hash);
+            applyTipChange(change);
+            break;
+        case BlockSideBranch:
+            POW_EV << "Block " << hash << " from peer " << blMsg->getSource() << " is on a side branch" << std::endl;
+            emit(blockArrivalDelaySignal, arrivalDelay);
+            emit(blockReceivedSignal, (long)hash);
+            emit(sideBranchBlockSignal, (long)hash);
+            break;
+        case BlockOrphan:
+            emit(orphanBlockSignal, 1);
+            break;
+        case BlockRejected:
+            emit(rejectedBlockSignal, 1);
+            break;
+        case BlockKnown:
+            break;
+        }
     }
     chainHeight = blockchain->chainHeight();
-    updateOutputsSpent();
+    if (tipHeader().hash != oldTip) {
+        // our current work is stale, start mining on the new tip
+        scheduleNextBlock();
+    }
+    finishSyncStep(blMsg->getSource(), SyncBlocksInFlight);
 }
 
 void POWNode::handleScheduledMessage(SchedulerMessage *msg) {
-    EV << "Handling simulation scheduled message" << msg << std::endl;
+    POW_EV << "Handling simulation scheduled message" << msg << std::endl;
+    if (!isOnline() && strcmp(msg->getName(), POWScheduler::SCHEDULER_MESSAGE_NODE_JOIN) != 0) {
+        POW_EV << "Node is offline.  Ignoring simulation scheduled message " << msg << std::endl;
+        return;
+    }
     auto handlerIt = simulationScheduleHandlers.find(msg->getName());
     if (handlerIt != simulationScheduleHandlers.end()) {
-        EV_DETAIL << "Calling handler for " << msg << std::endl;
+        POW_EV_DETAIL << "Calling handler for " << msg << std::endl;
+        ProfileScope profile(profiler, msg->getName());
         handlerIt->second(*this, msg);
     } else {
-        EV << "No handler for simulation scheduled message " << msg << std::endl;
+        POW_EV << "No handler for simulation scheduled message " << msg << std::endl;
     }
 }
 
@@ -560,49 +1345,165 @@ void POWNode::handleGetHeadersMessage(POWMessage *msg) {
     GetHeadersMessage *ghMsg = check_and_cast<GetHeadersMessage *>(msg);
     int meNode = getIndex();
     int sourceNode = ghMsg->getSource();
-    EV << "Handling request for headers from " << sourceNode << std::endl;
-    std::string bubbleMsg = "Received request for headers from " + std::to_string(sourceNode);
-    bubble(bubbleMsg.c_str());
+    POW_EV << "Handling request for headers from " << sourceNode << std::endl;
+    POW_BUBBLE("Received request for headers from " + std::to_string(sourceNode));
     // TODO: find headers that sender does not know about in our chain
-    std::vector<BlockHeader> toSend;
-    auto newBlocks = blockchain->getBlocksAfter(ghMsg->getHash());
-    for (auto block : newBlocks) {
-        toSend.push_back(block.getHeader());
-    }
-    sendToNode(messageGen->generateHeadersMessage(meNode, toSend), sourceNode);
+    // headers are kept for the whole chain, even when the blocks are pruned
+    sendToNode(messageGen->generateHeadersMessage(meNode, blockchain->getHeadersAfter(ghMsg->getHash())), sourceNode);
 }
 
 void POWNode::handleHeadersMessage(POWMessage *msg) {
     HeadersMessage *headersMsg = check_and_cast<HeadersMessage*>(msg);
-    int meNode = getIndex();
     int sourceNode = msg->getSource();
-    EV << "Handling headers received from " << sourceNode << std::endl;
-    std::string bubbleMsg = "Received " + std::to_string(headersMsg->getHeaders().size()) + " headers from peer " + std::to_string(sourceNode);
-    EV << bubbleMsg << std::endl;
-    bubble(bubbleMsg.c_str());
+    POW_EV << "Handling headers received from " << sourceNode << std::endl;
+    POW_EV << "Received " << headersMsg->getHeaders().size() << " headers from peer " << sourceNode << std::endl;
+    POW_BUBBLE("Received " + std::to_string(headersMsg->getHeaders().size()) + " headers from peer " + std::to_string(sourceNode));
     int64_t hashLastBlock = BlockHeader::NULL_HASH;
     int64_t requestHeader = BlockHeader::NULL_HASH;
-    bool foundOldest = false;
     for (auto header : headersMsg->getHeaders()) {
         if (hashLastBlock != BlockHeader::NULL_HASH && header.parentHash != hashLastBlock) {
             // non continuous headers sequence
-            EV_WARN << "Received non continuous headers sequence from " << sourceNode << std::endl;
+            POW_EV_WARN << "Received non continuous headers sequence from " << sourceNode << std::endl;
             return;
         }
-        if (blockchain->chainHeight() == 0 || (!foundOldest && header.parentHash == blockchain->getTip().getHeader().hash)) {
-            foundOldest = true;
+        // the first new block whose parent we have, on our chain or a side branch
+        if (requestHeader == BlockHeader::NULL_HASH && !blockchain->contains(header.hash) &&
+                (blockchain->chainHeight() == 0 || blockchain->contains(header.parentHash))) {
             requestHeader = header.hash;
         }
         hashLastBlock = header.hash;
     }
-    if (foundOldest) {
-        EV << "Sending get blocks request to " << sourceNode << std::endl;
-        sendToNode(messageGen->generateGetBlocksMessage(meNode, requestHeader), sourceNode);
+    if (requestHeader != BlockHeader::NULL_HASH) {
+        POW_EV << "Sending get blocks request to " << sourceNode << std::endl;
+        requestBlocks(sourceNode, requestHeader);
+    } else if (hashLastBlock != BlockHeader::NULL_HASH && blockchain->contains(hashLastBlock)) {
+        // the headers connect, and we have the peer's tip
+        POW_EV << "Already have the blocks of peer " << sourceNode << std::endl;
+        finishSyncStep(sourceNode, SyncHeadersRequested);
     } else {
-        EV << "Could not connect new block to our blockchain." << std::endl;
+        // no headers (the block we asked from is not on the peer's chain), or none that connect
+        handleUnconnectedHeaders(sourceNode);
     }
 }
 
+void POWNode::handleLightHeadersMessage(POWMessage *msg) {
+    HeadersMessage *headersMsg = check_and_cast<HeadersMessage*>(msg);
+    int sourceNode = msg->getSource();
+    POW_EV << "Received " << headersMsg->getHeaders().size() << " headers from peer " << sourceNode << std::endl;
+    POW_BUBBLE("Received " + std::to_string(headersMsg->getHeaders().size()) + " headers from peer " + std::to_string(sourceNode));
+    int64_t firstAdded = BlockHeader::NULL_HASH;
+    bool orphaned = false;
+    for (const BlockHeader &header : headersMsg->getHeaders()) {
+        TipChange change;
+        switch (headerChain->addHeader(header, &change)) {
+        case BlockAdded:
+            // the headers are one branch, so the first reorganization reaches back the furthest
+            if (firstAdded == BlockHeader::NULL_HASH) {
+                firstAdded = change.connected.front();
+            }
+            if (!change.disconnected.empty()) {
+                // the coins of a light node are only credited, so there is nothing to undo
+                POW_EV << "Reorganizing the header chain: " << change.disconnected.size() << " headers left it" << std::endl;
+                emit(reorgSignal, (long)change.disconnected.size());
+            }
+            emit(blockArrivalDelaySignal, simTime() - header.creationTime);
+            emit(blockReceivedSignal, (long)header.hash);
+            break;
+        case BlockSideBranch:
+            emit(blockArrivalDelaySignal, simTime() - header.creationTime);
+            emit(blockReceivedSignal, (long)header.hash);
+            emit(sideBranchBlockSignal, (long)header.hash);
+            break;
+        case BlockOrphan:
+            orphaned = true;
+            emit(orphanBlockSignal, 1);
+            break;
+        case BlockRejected:
+            emit(rejectedBlockSignal, 1);
+            break;
+        case BlockKnown:
+            break;
+        }
+    }
+    chainHeight = headerChain->chainHeight();
+    if (firstAdded != BlockHeader::NULL_HASH) {
+        POW_EV << "Requesting filtered blocks from " << sourceNode << std::endl;
+        requestBlocks(sourceNode, firstAdded);
+    } else if (!orphaned && !headersMsg->getHeaders().empty()) {
+        // the headers connect, and we have the peer's tip
+        finishSyncStep(sourceNode, SyncHeadersRequested);
+    } else {
+        handleUnconnectedHeaders(sourceNode);
+    }
+}
+
+void POWNode::handleMerkleBlocksMessage(POWMessage *msg) {
+    MerkleBlocksMessage *merkleMsg = check_and_cast<MerkleBlocksMessage*>(msg);
+    int publicKey = getIndex() * 2;
+    POW_EV << "Received " << merkleMsg->getMerkleBlocks().size() << " filtered blocks from peer " << msg->getSource() << std::endl;
+    for (const MerkleBlock &merkleBlock : merkleMsg->getMerkleBlocks()) {
+        const BlockHeader *header = headerChain->find(merkleBlock.header.hash);
+        if (!header) {
+            POW_EV << "Filtered block " << merkleBlock.header.hash << " is not in our header chain.  Ignoring it." << std::endl;
+            continue;
+        }
+        for (txs_size i = 0; i < merkleBlock.transactions.size() && i < merkleBlock.proofs.size(); ++i) {
+            const Transaction &tx = merkleBlock.transactions[i];
+            Hash256 digest = tx.computeDigest();
+            if (identifierOf(digest) != tx.hash || !merkleBlock.proofs[i].verify(digest, header->merkleRoot)) {
+                POW_EV_WARN << "Transaction " << tx.hash << " is not in block " << header->hash << std::endl;
+                continue;
+            }
+            recordConfirmation(tx);
+            // the same block can be sent by several peers, so each transaction is only credited once
+            if (state.outputsSpent.count(tx.hash) > 0) {
+                continue;
+            }
+            for (int n = 0; n < (int)tx.outputs.size(); ++n) {
+                if (tx.outputs[n].publicKey == publicKey) {
+                    state.outputsSpent[tx.hash][n] = tx.outputs[n].value;
+                    coins += tx.outputs[n].value;
+                }
+            }
+        }
+    }
+    finishSyncStep(merkleMsg->getSource(), SyncBlocksInFlight);
+}
+
+void POWNode::handleFilterLoadMessage(POWMessage *msg) {
+    FilterLoadMessage *filterMsg = check_and_cast<FilterLoadMessage*>(msg);
+    int sourceNode = filterMsg->getSource();
+    POW_EV << "Peer " << sourceNode << " is a light node.  Loading its filter of " << filterMsg->getPublicKeys().size() << " keys." << std::endl;
+    auto &peer = peers[sourceNode];
+    peer->filter = std::set<int>(filterMsg->getPublicKeys().begin(), filterMsg->getPublicKeys().end());
+    // a light peer has no blocks to send us, so we never sync from it
+    peer->flags.set(FilterLoaded);
+    if (peer->syncState == SyncHeadersRequested || peer->syncState == SyncBlocksInFlight) {
+        // its filterload arrived after its verack.  sync from another peer instead
+        peer->syncState = SyncIdle;
+        rescheduleSyncTimeout();
+        for (auto peerIt = peers.begin(); peerIt != peers.end() && countSyncing() == 0; ++peerIt) {
+            if (peerIt->second->flags.test(SuccessfullyConnected)) {
+                startBlockSync(peerIt->first);
+            }
+        }
+    }
+}
+
+void POWNode::handleGetMerkleBlocksMessage(POWMessage *msg) {
+    GetHeadersMessage *getMsg = check_and_cast<GetHeadersMessage*>(msg);
+    int sourceNode = getMsg->getSource();
+    POW_EV << "Handling request for filtered blocks from " << sourceNode << std::endl;
+    if (blockchain->isPruned(getMsg->getHash())) {
+        POW_EV << "Requested blocks were pruned.  Refusing request from " << sourceNode << std::endl;
+        sendToNode(messageGen->generateRejectMessage(getIndex(), false, "pruned"), sourceNode);
+        return;
+    }
+    auto newBlocks = blockchain->getBlocksAfter(getMsg->getHash());
+    std::copy(newBlocks.begin(), newBlocks.end(), std::back_inserter(peers[sourceNode]->merkleBlocksToSend));
+    wakeQueues();
+}
+
 void POWNode::handleNodeVersionMessage(POWMessage *msg) {
     VersionMessage *versionMsg = check_and_cast<VersionMessage*>(msg);
     int sourceNode = versionMsg->getSource();
@@ -610,39 +1511,36 @@ void POWNode::handleNodeVersionMessage(POWMessage *msg) {
     int sourceVersionNo = versionMsg->getVersionNo();
     if (sourceVersionNo < minAcceptedVersionNumber) {
         // disconnect from nodes that are too old
-        EV << "Node " << sourceNode << " using obsolete protocol version.  Minimum accepted version is " << minAcceptedVersionNumber << std::endl;
+        POW_EV << "Node " << sourceNode << " using obsolete protocol version.  Minimum accepted version is " << minAcceptedVersionNumber << std::endl;
         sendToNode(messageGen->generateRejectMessage(meNode, true, "obsolete"), sourceNode);
         disconnectNode(sourceNode);
     } else {
-        std::string bubbleMessage = "Received valid version message from " + std::to_string(sourceNode);
-        bubble(bubbleMessage.c_str());
+        POW_BUBBLE("Received valid version message from " + std::to_string(sourceNode));
         bool sourceInbound = peers[sourceNode]->flags.test(Inbound);
         // TODO: store starting height of incoming node
         if (sourceInbound) {
-            EV << "Sending node version message to inbound peer " << sourceNode << std::endl;
-            sendToNode(messageGen->generateVersionMessage(meNode, blockchain->chainHeight()), sourceNode);
+            POW_EV << "Sending node version message to inbound peer " << sourceNode << std::endl;
+            sendToNode(messageGen->generateVersionMessage(meNode, chainHeight), sourceNode);
+            if (lightNode) {
+                sendToNode(messageGen->generateFilterLoadMessage(meNode, {meNode * 2}), sourceNode);
+            }
         }
 
-        EV << "Node " << sourceNode << " is compatible.  Sending VERACK." << std::endl;
+        POW_EV << "Node " << sourceNode << " is compatible.  Sending VERACK." << std::endl;
         peers[sourceNode]->version = sourceVersionNo;
         int sourceChainHeight = versionMsg->getChainHeight();
-        if (sourceChainHeight > state.bestPeerHeight) {
-            state.bestPeerHeight = sourceChainHeight;
-            peers[sourceNode]->knownHeight = sourceChainHeight;
-            if (sourceChainHeight > blockchain->chainHeight()) {
-                peers[sourceNode]->flags.set(RequestHeaders);
-            }
-        }
+        peers[sourceNode]->knownHeight = sourceChainHeight;
+        state.bestPeerHeight = std::max(state.bestPeerHeight, sourceChainHeight);
 
         sendToNode(messageGen->generateMessage(meNode, MessageGenerator::MESSAGE_VERACK_COMMAND), sourceNode);
 
         /* BTC asks for addresses upon receiving version message, but we use a polling approach
         if (!sourceInbound) {
-            EV << "Adding self address " << meNode << " to addresses to be sent to outbound peer " << sourceNode << std::endl;
+            POW_EV << "Adding self address " << meNode << " to addresses to be sent to outbound peer " << sourceNode << std::endl;
             // TODO: check for listen flag and not isInitialBlockDownload
             peers[sourceNode]->addressesToBeSent.insert(meNode);
 
-            EV << "Sending addresses request on outbound connection." << std::endl;
+            POW_EV << "Sending addresses request on outbound connection." << std::endl;
             // TODO: check for ideal number of addresses
             sendToNode(messageGen->generateMessage(meNode, MessageGenerator::MESSAGE_GETADDR_COMMAND, ""), sourceNode);
             peers[sourceNode]->flags.set(HasGetAddr);
@@ -654,32 +1552,27 @@ void POWNode::handleNodeVersionMessage(POWMessage *msg) {
 
 void POWNode::handleVerackMessage(POWMessage *msg) {
     int sourceIndex = msg->getSource();
-    int meIndex = getIndex();
-    std::string connectionType = "inbound";
+    const char *connectionType = "inbound";
     if (!peers[sourceIndex]->flags.test(Inbound))  {
         // TODO: mark the node's state with the currently connected flag, so the timestamp is updated later
         connectionType = "outbound";
     } else {
         // if this is an inbound connection it might be from a node we didn't know about before
-        EV_DETAIL << "Adding peer " << sourceIndex << " to known indexes of peer " << getIndex() << std::endl;
+        POW_EV_DETAIL << "Adding peer " << sourceIndex << " to known indexes of peer " << getIndex() << std::endl;
         addrMan->addAddress(sourceIndex);
     }
-    std::string bubbleMessage = "Handling verack message from " + connectionType + " peer " + std::to_string(sourceIndex);
-    bubble(bubbleMessage.c_str());
-    EV << "Handling verack message from " << connectionType << " peer " << sourceIndex << std::endl;
-    EV << "Marking peer " << sourceIndex << " as successfully connected." << std::endl;
+    POW_BUBBLE(std::string("Handling verack message from ") + connectionType + " peer " + std::to_string(sourceIndex));
+    POW_EV << "Handling verack message from " << connectionType << " peer " << sourceIndex << std::endl;
+    POW_EV << "Marking peer " << sourceIndex << " as successfully connected." << std::endl;
     peers[sourceIndex]->flags.set(SuccessfullyConnected);
-    if (peers[sourceIndex]->flags.test(RequestHeaders) && peers[sourceIndex]->knownHeight == state.bestPeerHeight) {
-        sendToNode(messageGen->generateGetHeadersMessage(meIndex, blockchain->getTip().getHeader().hash), sourceIndex);
-    }
+    startBlockSync(sourceIndex);
 }
 
 void POWNode::handleRejectMessage(POWMessage *msg) {
     RejectMessage *rejectMsg = check_and_cast<RejectMessage*>(msg);
     int source = rejectMsg->getSource();
-    std::string bubbleMessage = "Received reject message from " + std::to_string(source);
-    bubble(bubbleMessage.c_str());
-    EV << "Reject reason: " << rejectMsg->getReason() << std::endl;
+    POW_BUBBLE("Received reject message from " + std::to_string(source));
+    POW_EV << "Reject reason: " << rejectMsg->getReason() << std::endl;
     if (rejectMsg->getDisconnect()) {
         disconnectNode(source);
     }
@@ -689,7 +1582,7 @@ void POWNode::relayAddress(int address) {
     // NOTE: BTC does some hashing nonsense to determine the best nodes to send to, but we'll just pick two random ones
     /* TODO: unsure if we should still relay addresses while polling
      * or just poll more frequently
-    EV << "Relaying addresses" << std::endl;
+    POW_EV << "Relaying addresses" << std::endl;
     for (int a : addrMan->getRandomAddresses()) {
         peers[a]->addressesToBeSent.insert(address);
     }
@@ -699,14 +1592,13 @@ void POWNode::relayAddress(int address) {
 void POWNode::handleAddrsMessage(POWMessage *msg) {
     AddrsMessage *addrsMsg = check_and_cast<AddrsMessage*>(msg);
     int messageSource = addrsMsg->getSource();
-    std::string bubbleMessage = "handling addrs message from peer: " + std::to_string(messageSource);
-    bubble(bubbleMessage.c_str());
-    EV << "Handling addrs message from peer " << messageSource << std::endl;
+    POW_BUBBLE("handling addrs message from peer: " + std::to_string(messageSource));
+    POW_EV << "Handling addrs message from peer " << messageSource << std::endl;
     std::vector<int> newAddresses = addrsMsg->getAddresses();
-    EV << "Received " << newAddresses.size() << " addresses from node " << messageSource << std::endl;
+    POW_EV << "Received " << newAddresses.size() << " addresses from node " << messageSource << std::endl;
     // TODO: attempt to connect to some if not all of the new peers
     dynamicConnect(newAddresses);
-    broadcastMessage(messageGen->generateVersionMessage(getIndex(), blockchain->chainHeight()), [&,this](int peerIndex) {
+    broadcastVersion([&,this](int peerIndex) {
         return !this->peers[peerIndex]->flags.test(SuccessfullyConnected) && !this->peers[peerIndex]->flags.test(Inbound);
     });
     addrMan->addAddresses(newAddresses);
@@ -723,15 +1615,14 @@ void POWNode::handleTxMessage(POWMessage *msg) {
 void POWNode::handleAddrMessage(POWMessage *msg) {
     /* see handleAddrsMessage (we are using a polling approach)
     int messageSource = msg->getSource();
-    std::string bubbleMessage = "handling addr message from peer " + std::to_string(messageSource) + " containing data " + msg->getData();
-    bubble(bubbleMessage.c_str());
-    EV << "Handling addr message from peer " << messageSource << std::endl;
+    POW_BUBBLE("handling addr message from peer " + std::to_string(messageSource) + " containing data " + msg->getData());
+    POW_EV << "Handling addr message from peer " << messageSource << std::endl;
     std::vector<int> newAddresses = getMessageDataVector(msg, "addresses");
     if (newAddresses.size() > maxAddrAd) {
         // TODO: mark peer as misbehaving
         return;
     }
-    EV << "Received addresses: " << newAddresses.size() << " from node " << messageSource << std::endl;
+    POW_EV << "Received addresses: " << newAddresses.size() << " from node " << messageSource << std::endl;
     std::vector<int> okAddresses;
     for (int addr : newAddresses) {
         peers[messageSource]->knownAddresses.insert(addr);
@@ -756,27 +1647,33 @@ void POWNode::handleAddrMessage(POWMessage *msg) {
 void POWNode::handleGetBlocksMessage(POWMessage *msg) {
     GetHeadersMessage *bhMessage = check_and_cast<GetHeadersMessage*>(msg);
     int messageSource = bhMessage->getSource();
-    EV << "Handling getblocks message from " << messageSource << std::endl;
+    POW_EV << "Handling getblocks message from " << messageSource << std::endl;
+    if (blockchain->isPruned(bhMessage->getHash())) {
+        // like BTC's pruned nodes, we only serve the blocks we still have
+        POW_EV << "Requested blocks were pruned.  Refusing request from " << messageSource << std::endl;
+        sendToNode(messageGen->generateRejectMessage(getIndex(), false, "pruned"), messageSource);
+        return;
+    }
     auto newBlocks = blockchain->getBlocksAfter(bhMessage->getHash());
     std::copy(newBlocks.begin(), newBlocks.end(), std::back_inserter(peers[messageSource]->blocksToSend));
+    wakeQueues();
 }
 
 void POWNode::handleGetAddrMessage(POWMessage *msg) {
     int messageSource = msg->getSource();
-    std::string bubbleMessage = "Handling get_addr message from " + std::to_string(messageSource);
-    bubble(bubbleMessage.c_str());
-    EV << "Handling getaddr message from peer " << messageSource << std::endl;
+    POW_BUBBLE("Handling get_addr message from " + std::to_string(messageSource));
+    POW_EV << "Handling getaddr message from peer " << messageSource << std::endl;
     /* BTC only allows getaddr messages on inbound connections to prevent fingerprinting attacks
      * but we can ignore that herer
     if (!peers[messageSource]->flags.test(Inbound)) {
-        EV << "Ignoring getaddr message from outbound connection peer " << messageSource << std::endl;
+        POW_EV << "Ignoring getaddr message from outbound connection peer " << messageSource << std::endl;
         return;
     }
     */
 
     /* Bitcoin ignores repeated getaddr messages, but we are using a polling approach
     if (peers[messageSource]->flags.test(HasSentAddr)) {
-        EV << "Ignoring repeated getaddr message from peer " << messageSource << std::endl;
+        POW_EV << "Ignoring repeated getaddr message from peer " << messageSource << std::endl;
         return;
     }
     peers[messageSource]->flags.set(HasSentAddr);
@@ -785,7 +1682,7 @@ void POWNode::handleGetAddrMessage(POWMessage *msg) {
     /* with polling approach, we just send addresses as soon as they are requested, instead of putting them on a queue to be sent later
     peers[messageSource]->addressesToBeSent.clear();
     auto pushAddresses = addrMan->getRandomAddresses();
-    EV << "Adding " << pushAddresses.size() << " addresses to be sent to node " << messageSource << std::endl;
+    POW_EV << "Adding " << pushAddresses.size() << " addresses to be sent to node " << messageSource << std::endl;
     for (auto it = pushAddresses.begin(); it != pushAddresses.end(); ++it) {
         peers[messageSource]->addressesToBeSent.insert(*it);
     }
@@ -797,95 +1694,165 @@ void POWNode::handleGetAddrMessage(POWMessage *msg) {
 
 #if(1) // handle simulation scheduled messages
 void POWNode::handleNewBlock(SchedulerMessage *msg) {
-    EV << "Attempting to handle new block" << std::endl;
+    POW_EV << "Attempting to handle new block" << std::endl;
     if (!isMiner) {
-        EV_ERROR << "Only miners can create new blocks" << std::endl;
+        POW_EV_ERROR << "Only miners can create new blocks" << std::endl;
         error("only miners can create new blocks");
     } else {
-        EV << "Miner node " << getIndex() << " received new block message" << std::endl;
-        std::string bubbleMessage = "Creating new block!";
-        //bubble(bubbleMessage.c_str());
-        EV << "Creating new block" << std::endl;
-        int64_t prev = BlockHeader::NULL_HASH;
-        EV_DETAIL << "Checking chain height" << std::endl;
-        if (blockchain->chainHeight() != 0) {
-            EV_DETAIL << "Chain is not empty.  Adding chain tip as parent" << std::endl;
-            prev = blockchain->getTip().getHeader().hash;
-        }
-        EV << "New block will include " << state.verifiedTransactions.size() << " verified transactions." << std::endl;
-        int64_t maxHash = blockchain->getMaxTxHash() + 1;
-        for (auto tx : state.verifiedTransactions) {
-            if (tx.hash == maxHash) {
-                tx.hash = maxHash + 1;
-            }
-            if (tx.hash > maxHash) {
-                maxHash = tx.hash + 1;
-            }
-        }
-        Block result = Block::create(getIndex(),
-                maxHash, coinbaseOutput,
-                prev, simTime().inUnit(SimTimeUnit::SIMTIME_S));
-        for (auto tx : state.verifiedTransactions) {
-            EV << "Adding verified transaction to block" << std::endl;
-            result.addTransaction(tx);
-        }
-        EV_DETAIL << "Resulting block:" << std::endl;
-        EV_DETAIL << result.to_string() << std::endl;
-        state.verifiedTransactions.clear();
-        state.blocksToAnnounce.push_back(result.getHeader());
-        EV << "New block contains " << result.getTx().size() << " transactions, including coinbase." << std::endl;
-        blockchain->addBlock(std::move(result));
-        chainHeight = blockchain->chainHeight();
-        updateOutputsSpent();
+        POW_EV << "Miner node " << getIndex() << " received new block message" << std::endl;
+        createBlock();
     }
 }
 
+void POWNode::createBlock() {
+    //POW_BUBBLE("Creating new block!");
+    POW_EV << "Creating new block" << std::endl;
+    int64_t prev = BlockHeader::NULL_HASH;
+    POW_EV_DETAIL << "Checking chain height" << std::endl;
+    if (blockchain->chainHeight() != 0) {
+        POW_EV_DETAIL << "Chain is not empty.  Adding chain tip as parent" << std::endl;
+        prev = blockchain->getTip().getHeader().hash;
+    }
+    POW_EV << "New block will include " << state.verifiedTransactions.size() << " verified transactions." << std::endl;
+    double difficulty = blockchain->nextDifficulty(initialDifficulty, retargetInterval, targetBlockInterval);
+    Block result = Block::create(getIndex(),
+            blockchain->chainHeight(), coinbaseOutput,
+            prev, simTime().inUnit(SimTimeUnit::SIMTIME_S), difficulty);
+    for (auto tx : state.verifiedTransactions) {
+        POW_EV << "Adding verified transaction to block" << std::endl;
+        result.addTransaction(tx);
+    }
+    POW_EV_DETAIL << "Resulting block:" << std::endl;
+    POW_EV_DETAIL << result.to_string() << std::endl;
+    state.verifiedTransactions.clear();
+    state.blocksToAnnounce.push_back(result.getHeader());
+    wakeQueues();
+    POW_EV << "New block contains " << result.getTx().size() << " transactions, including coinbase." << std::endl;
+    emit(blockReceivedSignal, (long)result.getHeader().hash);
+    TipChange change;
+    blockchain->addBlock(std::move(result), &change);
+    applyTipChange(change);
+    chainHeight = blockchain->chainHeight();
+    scheduleNextBlock();
+}
+
+void POWNode::blockFoundHandler(POWMessage *msg) {
+    POW_EV << "Miner node " << getIndex() << " solved the proof of work for a new block" << std::endl;
+    createBlock();
+}
+
+void POWNode::scheduleNextBlock() {
+    if (!isMiner || hashrate <= 0 || !isOnline()) {
+        return;
+    }
+    // finding a block is memoryless, so restarting the work on a new tip just means sampling a new time
+    double difficulty = blockchain->nextDifficulty(initialDifficulty, retargetInterval, targetBlockInterval);
+    simtime_t timeToFind = exponential(difficulty / hashrate);
+    POW_EV_DETAIL << "Next block expected in " << timeToFind << "s at difficulty " << difficulty << std::endl;
+    scheduleSelfMessage(MessageGenerator::MESSAGE_BLOCK_FOUND, simTime() + timeToFind);
+}
+
+void POWNode::handleNodeLeave(SchedulerMessage *msg) {
+    if (!isOnline()) {
+        POW_EV << "Node " << getIndex() << " is already offline." << std::endl;
+        return;
+    }
+    POW_EV << "Node " << getIndex() << " leaving the network." << std::endl;
+    POW_BUBBLE("Leaving network");
+    par("online").setBoolValue(false);
+
+    std::vector<int> connected;
+    for (auto &kv : nodeIndexToGateMap) {
+        connected.push_back(kv.first);
+    }
+    for (int peer : connected) {
+        disconnectNode(peer);
+    }
+    cancelSelfMessages();
+    for (auto &job : messagesInProcess) {
+        delete job.second;
+    }
+    messagesInProcess.clear();
+    std::fill(coreFreeTimes.begin(), coreFreeTimes.end(), SIMTIME_ZERO);
+
+    // the blockchain, known addresses and our wallet outputs stay in memory, standing in for what a real node keeps on disk.
+    // everything else is lost when the node goes down
+    auto outputsSpent = std::move(state.outputsSpent);
+    state = POWNodeState();
+    state.outputsSpent = std::move(outputsSpent);
+}
+
+void POWNode::handleNodeJoin(SchedulerMessage *msg) {
+    if (isOnline()) {
+        POW_EV << "Node " << getIndex() << " is already online." << std::endl;
+        return;
+    }
+    POW_EV << "Node " << getIndex() << " rejoining the network." << std::endl;
+    POW_BUBBLE("Rejoining network");
+    par("online").setBoolValue(true);
+    bootstrap(true);
+}
+
 void POWNode::handleNewTx(SchedulerMessage *msg) {
-    EV << "Attempting to handle new transaction" << std::endl;
-    if (blockchain->chainHeight() > 0) {
-        EV << "Initiating new transaction" << std::endl;
+    POW_EV << "Attempting to handle new transaction" << std::endl;
+    if (chainHeight > 0) {
+        POW_EV << "Initiating new transaction" << std::endl;
         Transaction tx;
         int peer = msg->getParameters()[0];
         int amount = msg->getParameters()[1];
         TransactionOutput txOut;
-        EV << "New transaction value = " << amount << " to peer " << peer << std::endl;
+        POW_EV << "New transaction value = " << amount << " to peer " << peer << std::endl;
         txOut.value = amount;
         txOut.publicKey = peer * 2;
-        auto prevTxMap = blockchain->getTip().getTx();
-        std::vector<TransactionInput> inputs;
-        for (auto prevTx : prevTxMap) {
-            for (int i = 0; i < prevTx.second.outputs.size(); ++i) {
-                if (prevTx.second.outputs[i].publicKey == getIndex() * 2) {
-                    // the transaction output is ours, so check if we've spent the output yet
-                    int outAmount = state.outputsSpent[prevTx.second.hash][i];
-                    if (outAmount > 0) {
-                        TransactionInput txIn;
-                        if (outAmount > amount) {
-                            state.outputsSpent[prevTx.second.hash][i] -= amount;
-                            amount = 0;
-                        } else {
-                            amount -= outAmount;
-                            state.outputsSpent[prevTx.second.hash][i] = 0;
-                        }
-                        txIn.prevTxHash = prevTx.second.hash;
-                        txIn.prevTxN = i;
-                        txIn.signature = getIndex() * 2 + 1;
-                        inputs.push_back(txIn);
+        // outputs paying us, as (transaction hash, output index)
+        std::vector<std::pair<int64_t, int>> ownOutputs;
+        if (lightNode) {
+            // a light node only knows of its outputs from the filtered blocks it was sent
+            for (const auto &txOutputs : state.outputsSpent) {
+                for (const auto &outputLeft : txOutputs.second) {
+                    ownOutputs.emplace_back(txOutputs.first, outputLeft.first);
+                }
+            }
+        } else {
+            for (const auto &prevTx : blockchain->getTip().getTx()) {
+                for (int i = 0; i < prevTx.second.outputs.size(); ++i) {
+                    if (prevTx.second.outputs[i].publicKey == getIndex() * 2) {
+                        ownOutputs.emplace_back(prevTx.second.hash, i);
                     }
                 }
             }
         }
+        std::vector<TransactionInput> inputs;
+        for (const auto &output : ownOutputs) {
+            // check if we've spent the output yet
+            int outAmount = state.outputsSpent[output.first][output.second];
+            if (outAmount > 0) {
+                TransactionInput txIn;
+                if (outAmount > amount) {
+                    state.outputsSpent[output.first][output.second] -= amount;
+                    amount = 0;
+                } else {
+                    amount -= outAmount;
+                    state.outputsSpent[output.first][output.second] = 0;
+                }
+                txIn.prevTxHash = output.first;
+                txIn.prevTxN = output.second;
+                txIn.signature = getIndex() * 2 + 1;
+                inputs.push_back(txIn);
+            }
+        }
         if (amount == 0) {
             coins -= txOut.value;
             tx.outputs.push_back(txOut);
             std::copy(inputs.begin(), inputs.end(), std::back_inserter(tx.inputs));
-            tx.hash = blockchain->getMaxTxHash() + 1;
+            tx.hash = tx.computeHash();
+            txSendTimes[tx.hash] = simTime();
             broadcastMessage(messageGen->generateTxMessage(getIndex(), tx), [&,this](int peerIndex) {
                 return this->peers[peerIndex]->flags.test(SuccessfullyConnected) && !this->peers[peerIndex]->flags.test(Disconnect);
             });
         } // currently no check that we aren't overspending, but we won't let that happen
     } else {
-        EV_WARN << "Can't handle new transaction before genesis block" << std::endl;
+        POW_EV_WARN << "Can't handle new transaction before genesis block" << std::endl;
     }
 }
 #endif
@@ -893,40 +1860,116 @@ void POWNode::handleNewTx(SchedulerMessage *msg) {
 #if(1) // utility function
 
 void POWNode::dynamicConnect(const std::vector<int> &newAddresses) {
-    EV << "Dynamically connecting to new addresses." << std::endl;
+    if (staticTopology) {
+        // connections can't be created across partitions
+        return;
+    }
+    POW_EV << "Dynamically connecting to new addresses." << std::endl;
     std::vector<int> toAdd;
     std::remove_copy_if(newAddresses.begin(), newAddresses.end(),
             std::back_inserter(toAdd), [&, this](int peer){ return this->nodeIndexToGateMap.find(peer) != this->nodeIndexToGateMap.end(); });
     // connect to half the peers to even out the number of inbound and outbound connections for each node
     int newCount = 0;
     for (int i = 0; i < toAdd.size() / 2; ++i) {
+        if (countConnections(false) >= maxOutboundConnections) {
+            POW_EV_DETAIL << "Outbound connection slots full.  Not connecting to remaining advertised peers." << std::endl;
+            break;
+        }
         ++newCount;
         int otherIndex = toAdd[i];
         connectTo(otherIndex, getPeerNodeByPath(otherIndex));
     }
-    EV_DETAIL << "Dynamically connected to " << newCount << " of " << newAddresses.size() << " advertised peers." << std::endl;
+    POW_EV_DETAIL << "Dynamically connected to " << newCount << " of " << newAddresses.size() << " advertised peers." << std::endl;
 }
 
 void POWNode::disconnectNode(int nodeIndex) {
-    EV << "Disconnecting from node " << nodeIndex << std::endl;
+    POW_EV << "Disconnecting from node " << nodeIndex << std::endl;
+    if (nodeIndexToGateMap.find(nodeIndex) == nodeIndexToGateMap.end()) {
+        POW_EV << "Not connected to node " << nodeIndex << std::endl;
+        return;
+    }
+    if (staticTopology) {
+        // the peer may be in another partition, so it has to be told with a message instead of a direct call
+        sendToNode(messageGen->generateRejectMessage(getIndex(), true, "disconnect"), nodeIndex);
+        removePeer(nodeIndex);
+    } else {
+        removePeer(nodeIndex);
+        getPeerNodeByPath(nodeIndex)->removePeer(getIndex());
+    }
+}
+
+void POWNode::removePeer(int nodeIndex) {
     auto mapIt = nodeIndexToGateMap.find(nodeIndex);
-    mapIt->second->disconnect();
+    if (mapIt == nodeIndexToGateMap.end()) {
+        return;
+    }
+    // once both ends have disconnected their outgoing gate, the gate pairs are free for getOrCreateFirstUnconnectedGatePair.
+    // static connections stay in place so they can be used again if the peer comes back
+    if (!staticTopology) {
+        mapIt->second->disconnect();
+    }
     nodeIndexToGateMap.erase(mapIt);
+    auto peer = peers.find(nodeIndex);
+    if (peer != peers.end()) {
+        // queued messages are owned by us until they are processed
+        for (POWMessage *queued : peer->second->incomingMessages) {
+            delete queued;
+        }
+        peers.erase(peer);
+    }
+    peersProcess.erase(std::remove(peersProcess.begin(), peersProcess.end(), nodeIndex), peersProcess.end());
 }
 
 void POWNode::logReceivedMessage(POWMessage *msg) const {
-    EV << msg->getName() << " message received by " << getIndex() << " from " << msg->getSource() << std::endl;
+    POW_EV << msg->getName() << " message received by " << getIndex() << " from " << msg->getSource() << std::endl;
 }
 
 void POWNode::sendToNode(POWMessage *msg, int nodeIndex) {
     auto mapIt = nodeIndexToGateMap.find(nodeIndex);
     if (mapIt != nodeIndexToGateMap.end()) {
-        send(msg, mapIt->second);
+        sendOnLink(msg, mapIt->second);
     } else {
-        EV << "Node " << nodeIndex << " not found.  Message not sent." << std::endl;
+        POW_EV << "Node " << nodeIndex << " not found.  Message not sent." << std::endl;
     }
 }
 
+void POWNode::recordConfirmations(const Block &block) {
+    if (txSendTimes.empty()) {
+        return;
+    }
+    for (const auto &txPair : block.getTx()) {
+        recordConfirmation(txPair.second);
+    }
+}
+
+void POWNode::recordConfirmation(const Transaction &tx) {
+    auto sentIt = txSendTimes.find(tx.hash);
+    // transaction hashes are only unique per chain, so check the transaction spends our outputs
+    if (sentIt != txSendTimes.end() && !tx.inputs.empty() && tx.inputs[0].signature == getIndex() * 2 + 1) {
+        emit(txConfirmationLatencySignal, simTime() - sentIt->second);
+        txSendTimes.erase(sentIt);
+    }
+}
+
+void POWNode::sendOnLink(POWMessage *msg, cGate *gate) {
+    bytesSentByType[msg->getName()] += msg->getByteLength();
+    emit(bytesSentSignal, msg->getByteLength());
+    // a datarate channel only accepts a packet once the previous one has been transmitted, so queue behind it
+    cChannel *channel = gate->findTransmissionChannel();
+    if (channel && channel->getTransmissionFinishTime() > simTime()) {
+        sendDelayed(msg, channel->getTransmissionFinishTime() - simTime(), gate);
+    } else {
+        send(msg, gate);
+    }
+}
+
+cChannel *POWNode::createLinkChannel(int destRegion) const {
+    auto channel = cDatarateChannel::create("channel");
+    channel->setDelay(latencyMatrix[region * numRegions + destRegion] / 1000);
+    channel->setDatarate(bandwidth);
+    return channel;
+}
+
 
 bool POWNode::isOnline() const {
     return par("online").boolValue();
@@ -952,32 +1995,80 @@ bool POWNode::checkMessageInScope(POWMessage *msg) {
     return true;
 }
 
-void POWNode::updateOutputsSpent() {
-    if (blockchain->chainHeight() > 0) {
-        EV << "Updating output values for peer " << getIndex() << std::endl;
-        EV_DETAIL << "Chain height = " << blockchain->chainHeight() << std::endl;
-        EV_DETAIL << "Chain tip has " << blockchain->getTip().getTx().size() << " transactions." << std::endl;
-        for (auto tx : blockchain->getTip().getTx()) {
-            EV_DETAIL << "Transaction with hash " << tx.second.hash << " has " << tx.second.outputs.size() << " outputs." << std::endl;
-            for (int i = 0; i < tx.second.outputs.size(); ++i) {
-                if (tx.second.outputs[i].publicKey == getIndex() * 2) {
-                    EV_DETAIL << "Transaction output index " << i << " has an output directed towards us.  Updating number of coins." << std::endl;
-                    if (state.outputsSpent.find(tx.second.hash) == state.outputsSpent.end()) {
-                        std::map<int,int> blankMap;
-                        state.outputsSpent[tx.second.hash] = blankMap;
-                    }
-                    int value = tx.second.outputs[i].value;
-                    state.outputsSpent[tx.second.hash][i] = value;
-                    coins += value;
-                }
+void POWNode::applyTipChange(const TipChange &change) {
+    if (!change.disconnected.empty()) {
+        POW_EV << "Reorganizing the chain: " << change.disconnected.size() << " blocks left it and " << change.connected.size() << " joined it" << std::endl;
+        emit(reorgSignal, (long)change.disconnected.size());
+    }
+    for (int64_t hash : change.disconnected) {
+        disconnectBlock(blockchain->findBlockByHash(hash));
+    }
+    for (int64_t hash : change.connected) {
+        connectBlock(blockchain->findBlockByHash(hash));
+    }
+}
+
+void POWNode::connectBlock(const Block &block) {
+    // only transactions of blocks on our chain are confirmed
+    recordConfirmations(block);
+    int publicKey = getIndex() * 2;
+    for (const auto &txPair : block.getTx()) {
+        const Transaction &tx = txPair.second;
+        for (int n = 0; n < (int)tx.outputs.size(); ++n) {
+            if (tx.outputs[n].publicKey == publicKey) {
+                POW_EV_DETAIL << "Output " << n << " of transaction " << tx.hash << " pays us.  Updating number of coins." << std::endl;
+                state.outputsSpent[tx.hash][n] = tx.outputs[n].value;
+                coins += tx.outputs[n].value;
+            }
+        }
+    }
+}
+
+void POWNode::disconnectBlock(const Block &block) {
+    for (const auto &txPair : block.getTx()) {
+        const Transaction &tx = txPair.second;
+        auto outputsIt = state.outputsSpent.find(tx.hash);
+        if (outputsIt != state.outputsSpent.end()) {
+            for (const auto &outputLeft : outputsIt->second) {
+                coins -= outputLeft.second;
             }
+            state.outputsSpent.erase(outputsIt);
+        }
+        if (isMiner && !tx.inputs.empty() && !tx.inputs[0].isCoinbase()) {
+            // as in BTC, transactions of blocks that left the chain go back to the mempool
+            state.unverifiedTransactions.push_back(tx);
         }
     }
 }
 
 void POWNode::refreshDisplay() const {
     char buf[128];
-    sprintf(buf, "chainheight: %d, coins: %d", chainHeight, coins);
+    sprintf(buf, "%s%schainheight: %d, coins: %d", isOnline() ? "" : "offline, ", lightNode ? "light, " : "", chainHeight, coins);
     getDisplayString().setTagArg("t", 0, buf);
 }
+
+void POWNode::finish() {
+    int64_t totalSent = 0, totalReceived = 0;
+    for (const auto &typeBytes : bytesSentByType) {
+        recordScalar(("bytesSent:" + typeBytes.first).c_str(), typeBytes.second, "B");
+        totalSent += typeBytes.second;
+    }
+    for (const auto &typeBytes : bytesReceivedByType) {
+        recordScalar(("bytesReceived:" + typeBytes.first).c_str(), typeBytes.second, "B");
+        totalReceived += typeBytes.second;
+    }
+    recordScalar("bytesSent", totalSent, "B");
+    recordScalar("bytesReceived", totalReceived, "B");
+    if (!coreFreeTimes.empty() && simTime() > SIMTIME_ZERO) {
+        recordScalar("cpuUtilization", cpuBusyTime.dbl() / (simTime().dbl() * coreFreeTimes.size()));
+    }
+    if (profiler) {
+        profiler->release();
+        profiler = nullptr;
+    }
+    if (workerPool) {
+        workerPool->release();
+        workerPool = nullptr;
+    }
+}
 #endif
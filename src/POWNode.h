@@ -15,18 +15,20 @@
 #include "messages/scheduler_message_m.h"
 #include "MessageGenerator.h"
 #include "pow_node_data.h"
+#include "handler_profiler.h"
+#include "worker_pool.h"
+#include "checkpoint.h"
 #include "addr_manager.h"
 #include "blockchain/blockchain.h"
+#include "blockchain/header_chain.h"
 #include "blockchain/tx.h"
 #include <functional>
 #include <memory>
-#include <queue>
+#include <deque>
 
 using namespace omnetpp;
 
 struct POWNodeState {
-    bool syncStarted;
-    int numSyncs;
     int bestPeerHeight;
     std::vector<Transaction> verifiedTransactions;
     std::vector<Transaction> unverifiedTransactions;
@@ -35,7 +37,7 @@ struct POWNodeState {
     // of the corresponding transaction output
     std::map<int64_t, std::map<int,int>> outputsSpent;
 
-    POWNodeState() : syncStarted(false), numSyncs(0), bestPeerHeight(-1) {
+    POWNodeState() : bestPeerHeight(-1) {
     }
 };
 
@@ -47,13 +49,26 @@ class POWNode: public P2PNode {
 public:
     POWNode();
     virtual ~POWNode();
+
+    /*! Append this node's state to a checkpoint: its blockchain, coins, mempool and other node state, known addresses,
+     * peers and pending self messages.  Times are written relative to the current time.  Messages queued from peers or
+     * still in flight are not part of the checkpoint.
+     * \param writer Record to append to.
+     */
+    void writeCheckpoint(CheckpointWriter &writer) const;
 protected:
     /*! Initialize the node.  Occurs during the set up stage of the simulation, before any messages are sent.
-     * Runs the following steps:
+     * Stage 0 sets up the node's own state, which is loaded from files or restored from a checkpoint (see the restoreCheckpoint parameter).
+     * Stage 1 runs once every node has been through stage 0, as connections need the state of both ends:
      * 1.  Establish connections with nodes in known node list (if no known nodes, just connect to a list of default nodes).
      * 2.  Broadcast our known nodes list (excluding default nodes)
+     * When restoring, stage 1 instead recreates the checkpointed connections, and stage 2 restores the peer data and self messages.
      */
-    virtual void initialize() override;
+    virtual void initialize(int stage) override;
+
+    virtual int numInitStages() const override {
+        return 3;
+    }
 
     /*! Process an incoming message.  Message gets added to incomingMessages queue, which gets processed at a user-specified
      * time interval.
@@ -63,7 +78,12 @@ protected:
 
     virtual void refreshDisplay() const override;
 
+    /*! Records the bytes sent and received for each message type as scalars, and releases the handler profiler and worker pool.
+     */
+    virtual void finish() override;
+
     /*! Check if the node is online (would be handled by TCP timeouts in real network).  Connections will not be established with an offline node.
+     * The online parameter is updated when the node leaves or rejoins the network.
      * \returns True if the node is online and can be connected to, false otherwise.
      */
     bool isOnline() const;
@@ -74,6 +94,18 @@ protected:
      * \param inboundValue True if the node marked by nodeIndex is initiating the connection
      */
     void addNodeToGateMapping(int nodeIndex, cGate *gate, bool inboundValue);
+
+    /*! Make room for a new inbound connection.  If the inbound slots are full, an existing inbound peer is evicted
+     * according to the inboundEvictionPolicy parameter.
+     * \returns True if a new inbound connection can be accepted, false otherwise.
+     */
+    bool acceptInboundConnection();
+
+    /*! Tear down our side of the connection with the given node, leaving the gate pair free to be reused.
+     * Any messages still queued from the peer are deleted and all data kept about the peer is released.
+     * \param nodeIndex Index of the peer being removed.
+     */
+    void removePeer(int nodeIndex);
 private:
     /*! Internal initialzation steps, done before anything network related.
      * These involve loading data files, connecting message handlers, etc.
@@ -87,20 +119,64 @@ private:
      */
     void readAddresses();
 
+    /*! Restore the node's own state from its checkpoint record.  Peer data and self messages are kept aside until
+     * the connections have been recreated (see finishRestore).
+     * \param checkpoint Checkpoint to restore from.
+     */
+    void restoreCheckpoint(const Checkpoint &checkpoint);
+
+    /*! Recreate the connections the node had when the checkpoint was taken.  Each node recreates its outbound connections.
+     *
+     */
+    void restoreConnections();
+
+    /*! Apply the checkpointed data of each peer to the recreated connections and schedule the checkpointed self messages.
+     *
+     */
+    void finishRestore();
+
     /*! One time initial scheduling of self messages (message handler, dump addresses, etc)
      *
      */
     void scheduleSelfMessages();
 
+    /*! Schedule a self message of the given type, replacing any pending self message of the same type.
+     * \param command Type of self message to schedule.
+     * \param time Time the message should arrive at.
+     */
+    void scheduleSelfMessage(const char *command, simtime_t time);
+
+    /*! Cancel the pending self message of the given type, if there is one.
+     * \param command Type of self message to cancel.
+     */
+    void cancelSelfMessage(const char *command);
+
+    /*! Cancel every pending self message.  Used when the node goes offline.
+     *
+     */
+    void cancelSelfMessages();
+
+    /*! Join the network: connect to known peers, start the self scheduled "threads" and send our version.
+     * Run on initialization and whenever the node comes back online.
+     * \param rejoin True if the node is coming back online after leaving the network.
+     */
+    void bootstrap(bool rejoin);
+
     /*! Read NED parameters that will not change during the simulation.
      *
      */
     void readConstantParameters();
 
     /*! Create connections to currently known list of networks (step 1 of initialization).  Each connection will create a new gate in the source and destination nodes if needed.
-     * In the future, the max number of connections may be a parameter in the network simulation (as the actual Bitcoin client has such a parameter).
+     * The number of connections is limited by the maxOutboundConnections and maxInboundConnections parameters (as the actual Bitcoin client does).
+     * \param rejoin True if the node is coming back online after leaving the network.
+     */
+    void initConnections(bool rejoin);
+
+    /*! Use the connections wired in the network description instead of creating our own (see the staticTopology parameter).
+     * \param rejoin True if the node is coming back online, in which case it initiates every connection.
      */
-    void initConnections();
+    void initStaticConnections(bool rejoin);
 
     /*! Connect message handlers using the name to member function map.
      *
@@ -157,6 +233,25 @@ private:
 
     void handleBlocksMessage(POWMessage *msg);
 
+    /*! Light node's handler for headers.  New headers are added to the header chain, and the transactions of those blocks
+     * that concern us are requested from the sender as filtered blocks.
+     * \param msg Message to handle.  Contains the headers.
+     */
+    void handleLightHeadersMessage(POWMessage *msg);
+
+    /*! Light node's handler for filtered blocks.  The transactions are checked against the Merkle roots of our headers,
+     * and the outputs paying us are added to our coins.
+     * \param msg Message to handle.  Contains the filtered blocks.
+     */
+    void handleMerkleBlocksMessage(POWMessage *msg);
+
+    /*! Store the filter of a light peer.  The peer is only sent filtered blocks, and is never asked for blocks.
+     * \param msg Message to handle.  Contains the public keys the peer wants the transactions of.
+     */
+    void handleFilterLoadMessage(POWMessage *msg);
+
+    void handleGetMerkleBlocksMessage(POWMessage *msg);
+
     /*! Handler for half of address polling interface.  Handles receiving addresses from a peer.
      * \param msg Message to handle.  Contains a set of addresses that we asked for.
      */
@@ -173,16 +268,84 @@ private:
      */
     void sendToNode(POWMessage *msg, int nodeIndex);
 
+    /*! Emits the confirmation latency of transactions this node sent that are included in the block.
+     * \param block Block that joined our chain.
+     */
+    void recordConfirmations(const Block &block);
+
+    /*! Emits the confirmation latency of the transaction if this node sent it.
+     * \param tx Transaction that is now in a block of our chain.
+     */
+    void recordConfirmation(const Transaction &tx);
+
+    /*! Turns eventlog recording of this node's events on or off according to the eventlogRecording parameter.
+     */
+    void initEventlogRecording();
+
+    /*! Sends a message over a peer connection, delaying it until the link has finished transmitting earlier messages.
+     * \param msg Message to send
+     * \param gate Output gate of the peer connection.
+     */
+    void sendOnLink(POWMessage *msg, cGate *gate);
+
+    /*! Creates the channel for a connection from this node to a node in the given region.
+     * The delay is taken from the latency matrix and the datarate is this node's bandwidth.
+     * \param destRegion Region of the node at the other end of the connection.
+     */
+    cChannel *createLinkChannel(int destRegion) const;
+
     /*! "Thread" that checks peers' incoming and outgoing message queues.
      * Calls processIncomingMessages and sendOutgoingMessages for each peer.
      * \param msg Message that initiated the check.  Not used (only here to work with the handler map)
      */
     void messageHandler(POWMessage *msg);
 
+    /*! With eventDrivenQueues, schedule a check of the queues at the current time, unless one is already pending, or every
+     * core is busy and there is no data to send.  Called whenever there is new work for messageHandler: a queue that was
+     * empty gets a message, a core becomes idle, blocks are queued for a peer, or a block is to be announced.
+     */
+    void wakeQueues();
+
+    /*! Whether any peer has messages that processIncomingMessages would process.
+     *
+     */
+    bool queuedMessages() const;
+
+    /*! Whether there is data sendOutgoingMessages or sendBroadcasts would send: blocks requested by a connected peer, or
+     * blocks to announce.
+     */
+    bool outgoingData() const;
+
     void handleNewBlock(SchedulerMessage *msg);
 
+    /*! Create a block on top of our chain tip containing the verified transactions, and queue it to be announced.
+     *
+     */
+    void createBlock();
+
+    /*! Self message for miners with a hashrate, indicating the proof of work for a new block has been solved.
+     * \param msg Message that initiated the block creation.
+     */
+    void blockFoundHandler(POWMessage *msg);
+
+    /*! Sample the time at which we will solve the proof of work on our current chain tip, replacing any earlier sample.
+     * The time is exponentially distributed with mean difficulty / hashrate.  Does nothing unless the node is an online miner with a hashrate.
+     */
+    void scheduleNextBlock();
+
     void handleNewTx(SchedulerMessage *msg);
 
+    /*! Take the node offline.  All connections are torn down and pending self messages are cancelled.  The blockchain,
+     * known addresses and wallet outputs are kept, as they would be persisted on disk.
+     * \param msg Scheduler message that initiated the leave.
+     */
+    void handleNodeLeave(SchedulerMessage *msg);
+
+    /*! Bring the node back online and bootstrap it from its kept blockchain and address state.
+     * \param msg Scheduler message that initiated the join.
+     */
+    void handleNodeJoin(SchedulerMessage *msg);
+
     /*! Self-scheduled message for nodes marked as miners.
      * Steps:
      * Collect broadcasted transactions and ensure they follow our policy
@@ -207,6 +370,27 @@ private:
      */
     void processMessage(POWMessage *msg);
 
+    /*! Start processing a message on the simulated CPU.  It is taken by the core that has been idle the longest, and its
+     * handler is called once processingCost has passed.  Messages that cost nothing are processed right away.
+     * \param msg Message from a peer queue.  Only called while a core is idle (see coreIdle).
+     */
+    void startProcessing(POWMessage *msg);
+
+    /*! Call the handlers of the messages the simulated CPU has finished processing.
+     * \param msg Self message that initiated the handler.  Not used (only here to work with the handler map)
+     */
+    void cpuDoneHandler(POWMessage *msg);
+
+    /*! CPU time needed to handle a message: the cost of its type, plus the cost of each transaction input it has to
+     * validate and of each byte of the blocks it holds.
+     */
+    simtime_t processingCost(POWMessage *msg) const;
+
+    /*! Whether a core of the simulated CPU is idle, so another message can be taken from the queues.  Always true when the
+     * CPU isn't simulated.
+     */
+    bool coreIdle() const;
+
     /*! Ask currently connected peers for their known addresses
      *
      */
@@ -225,13 +409,93 @@ private:
 
     void sendBroadcasts();
 
-    void startBlockSync(int peerTo);
+    /*! Send our version to the peers the predicate is true for.  Light nodes follow it with their filter.
+     * \param predicate Predicate used to filter peers.
+     */
+    void broadcastVersion(std::function<bool(int)> predicate);
+
+    /*! Header of the tip of our chain, or of our header chain for a light node.  A default header (NULL_HASH) if the chain is empty.
+     *
+     */
+    BlockHeader tipHeader() const;
+
+    /*! Headers of our chain: the header chain of a light node, or the headers of the blockchain.
+     *
+     */
+    const HeaderChain &activeHeaders() const;
+
+    /*! Hash of the block of our chain the given number of blocks before the tip, or NULL_HASH (the whole chain) if the
+     * chain is shorter.
+     */
+    int64_t locatorHash(long depth) const;
+
+    /*! Start block sync with a peer that just connected.  Headers are requested if we aren't syncing from another peer,
+     * the peer has the longest chain we've heard of, or our tip is recent (so we also follow the peer's new blocks).
+     * Light peers are never synced from.
+     * \param peerIndex Index of the peer.
+     */
+    void startBlockSync(int peerIndex);
 
-    /*! Disconnect from the specified node.
+    /*! Ask a peer for the headers of its chain after one of our blocks.  The peer's sync state becomes SyncHeadersRequested.
+     * \param peerIndex Index of the peer.
+     * \param depth Number of blocks before our tip the headers start at.  1, the parent of our tip, unless the peer's
+     * chain forked from ours further back.
+     */
+    void requestHeaders(int peerIndex, long depth = 1);
+
+    /*! Handle headers from a peer that don't connect to any block we know.  If they answer our request, ask again from
+     * twice as far back, until the whole chain was asked for.  Otherwise they announce blocks we missed, so ask for the
+     * headers after our tip.
+     * \param peerIndex Index of the peer.
+     */
+    void handleUnconnectedHeaders(int peerIndex);
+
+    /*! Ask a peer for the blocks after and including a header it sent, filtered for a light node.  The peer's sync state
+     * becomes SyncBlocksInFlight.
+     * \param peerIndex Index of the peer.
+     * \param hash Hash of the first block wanted.
+     */
+    void requestBlocks(int peerIndex, int64_t hash);
+
+    /*! Mark sync with a peer as done, if we were waiting for it.  Called when the peer's headers connect to our chain and
+     * we already have its tip, or once its blocks arrive.
+     * \param peerIndex Index of the peer.
+     * \param expected State the reply answers.  Replies the peer sent unasked don't change its state.
+     */
+    void finishSyncStep(int peerIndex, SyncState expected);
+
+    /*! Give up on the peers whose sync replies are overdue, and sync from another peer instead.  With no other peer,
+     * the stalled peer is asked again after a backoff that doubles each time, and disconnected after maxSyncRetries retries.
+     * \param msg Self message that initiated the handler.  Not used (only here to work with the handler map)
+     */
+    void syncTimeoutHandler(POWMessage *msg);
+
+    /*! Schedule the sync timeout self message for the earliest deadline of the peers we're waiting for or will retry, or
+     * cancel it if there are none.
+     */
+    void rescheduleSyncTimeout();
+
+    /*! Number of peers we're waiting for headers or blocks from.
+     *
+     */
+    int countSyncing() const;
+
+    /*! Disconnect from the specified node.  Both directions of the connection are torn down so the gate pairs
+     * on either end can be reused by later connections.
      * \param nodeIndex Index of node to disconnect
      */
     void disconnectNode(int nodeIndex);
 
+    /*! Count the currently established connections of the given direction.
+     * \param inbound True to count inbound connections, false to count outbound connections.
+     */
+    int countConnections(bool inbound) const;
+
+    /*! Choose which inbound peer to evict when the inbound slots are full.
+     * \returns Index of the peer to evict, or -1 if no peer should be evicted.
+     */
+    int selectInboundEvictionCandidate();
+
     /*! Part of node loop run post initialization.
      * Sends any necessary data to peers.
      */
@@ -243,12 +507,19 @@ private:
      */
     bool checkMessageInScope(POWMessage *msg);
 
-    /*! Create a connection with the specified node.
+    /*! Create a connection with the specified node.  No connection is made if our outbound slots are full
+     * or the other node cannot accept another inbound connection.
      * \param otherIndex index of the peer.  Used to map the gates in the connection.
      * \param other node representing the peer.  Used to make sure data stored and the connection are symmetric.
      */
     void connectTo(int otherIndex, POWNode *other);
 
+    /*! Wire a connection with the specified node, without checking whether either side has room for it.
+     * \param otherIndex index of the peer.
+     * \param other node representing the peer.
+     */
+    void linkTo(int otherIndex, POWNode *other);
+
     /*! Add connections to addresses received from an ADDRS message.
      * \param newAddresses Vector containing addresses of new peers.
      */
@@ -264,7 +535,20 @@ private:
      */
     void relayAddress(int address);
 
-    void updateOutputsSpent();
+    /*! Update our state for the blocks that left and joined our chain when a block was added.
+     * \param change Blocks that left and joined the chain, from Blockchain::addBlock.
+     */
+    void applyTipChange(const TipChange &change);
+
+    /*! A block joined our chain: record the confirmations of our transactions in it, and add its outputs paying us to our coins.
+     *
+     */
+    void connectBlock(const Block &block);
+
+    /*! A block left our chain in a reorganization: remove its outputs paying us from our coins, and put its transactions
+     * back in the mempool of a miner.
+     */
+    void disconnectBlock(const Block &block);
 
     POWNode *getPeerNodeByPath(int address) {
         std::string nodePath = "node[" + std::to_string(address) + "]";
@@ -275,8 +559,11 @@ private:
     // these are kept separate because self messages are processed immediately
     std::map<std::string, std::function<void(POWNode &, POWMessage *)> > selfMessageHandlers;
     std::map<std::string, std::function<void(POWNode &, SchedulerMessage *)> > simulationScheduleHandlers;
+    // at most one self message of each type is pending at a time
+    std::map<std::string, POWMessage *> pendingSelfMessages;
 
-    std::unique_ptr<Blockchain> blockchain;
+    std::unique_ptr<Blockchain> blockchain; // stays empty for a light node
+    std::unique_ptr<HeaderChain> headerChain; // only for a light node
 
     std::map<int, cGate*> nodeIndexToGateMap;
     int versionNumber;
@@ -288,19 +575,67 @@ private:
     int addrRelayVecSize;
     int dumpAddressesInterval;
     int blocksPerFile;
+    int pruneDepth; // number of block bodies kept.  0 keeps them all
     bool isMiner;
+    bool lightNode;
     int blockSyncRecency;
+    int syncTimeout; // seconds to wait for a sync reply from a peer
+    int maxSyncRetries; // times a stalled peer is asked again when there is no other peer to sync from
     double randomAddressFraction;
     int coinbaseOutput;
+    double hashrate;
+    double initialDifficulty;
+    int retargetInterval;
+    int targetBlockInterval;
     bool newNetwork;
     int stopAddrPollingTime;
+    bool staticTopology;
+    int maxOutboundConnections;
+    int maxInboundConnections;
+    std::string inboundEvictionPolicy;
+    int region;
+    int numRegions;
+    std::vector<double> latencyMatrix; // one way latency in ms, row major
+    double bandwidth;
+    // wire bytes per message type, counted whether or not the message was processed
+    std::map<std::string, int64_t> bytesSentByType;
+    std::map<std::string, int64_t> bytesReceivedByType;
+    std::map<int64_t, simtime_t> txSendTimes; // transactions sent by this node that are not yet in a block
+    int messagesProcessed; // messages processed since the last check of the queues
+    HandlerProfiler *profiler = nullptr; // null unless the profileHandlers parameter is set
+    WorkerPool *workerPool = nullptr; // null when validationThreads is 1, so transactions are validated on the simulation thread
+    // simulated CPU.  empty when cpuCores is 0, and messages are handled as soon as they are taken from the queues
+    std::vector<simtime_t> coreFreeTimes; // time each core finishes its current message
+    std::multimap<simtime_t, POWMessage *> messagesInProcess; // by the time they finish.  owned by us until they are handled
+    std::map<std::string, simtime_t> processingCosts; // CPU time per message type
+    simtime_t inputValidationCost;
+    simtime_t blockByteCost;
+    simtime_t cpuBusyTime; // summed over the cores
+    std::string restoreFile; // checkpoint the node starts from, empty for a normal start
+    // checkpointed peer data and self messages, held between initialization stages while restoring
+    std::map<int, std::unique_ptr<POWNodeData> > restoredPeers;
+    std::map<std::string, simtime_t> restoredSelfMessages;
+    simsignal_t queueDepthSignal;
+    simsignal_t messagesProcessedSignal;
+    simsignal_t blockArrivalDelaySignal;
+    simsignal_t blockReceivedSignal;
+    simsignal_t orphanBlockSignal;
+    simsignal_t rejectedBlockSignal;
+    simsignal_t sideBranchBlockSignal;
+    simsignal_t reorgSignal;
+    simsignal_t txConfirmationLatencySignal;
+    simsignal_t bytesSentSignal;
+    simsignal_t bytesReceivedSignal;
+    simsignal_t processingDelaySignal;
+    simsignal_t syncTimeoutSignal;
     std::vector<int> defaultNodes;
     std::unique_ptr<MessageGenerator> messageGen;
     // maintain data known about each peer
     std::map<int, std::unique_ptr<POWNodeData> > peers;
     std::unique_ptr<AddrManager> addrMan;
-    std::queue<int> peersProcess; // make sure nodes are processed fairly
+    std::deque<int> peersProcess; // make sure nodes are processed fairly
     int threadScheduleInterval;
+    bool eventDrivenQueues; // check the queues when there is work, instead of every threadScheduleInterval
     int currentMessagesProcessed;  // counter for number of messages that have been processed in one loop
     std::string addressesFile;
     std::string blocksDir;
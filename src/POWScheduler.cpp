@@ -15,9 +15,10 @@
 
 #include "POWScheduler.h"
 #include <iostream>
-#include <fstream>
 #include <string>
-#include "messages/scheduler_message_m.h"
+#include "pow_logging.h"
+#include "checkpoint.h"
+#include "POWNode.h"
 
 POWScheduler::POWScheduler() {
 
@@ -28,38 +29,168 @@ POWScheduler::~POWScheduler() {
 }
 
 void POWScheduler::initialize() {
-    int timeToStartSchedule = par("timeToStartSchedule").intValue();
-    simtime_t time = simTime() + timeToStartSchedule;
-    EV << "Schedule to start at " << time;
+    timeToStartSchedule = par("timeToStartSchedule").intValue();
+    std::string restoreFile = par("restoreCheckpoint").stdstringValue();
+    const Checkpoint *checkpoint = restoreFile.empty() ? nullptr : &Checkpoint::load(restoreFile);
+    restoredTime = checkpoint ? simtime_t(checkpoint->getTime()) : SIMTIME_ZERO;
+    // a restored run continues the schedule where the checkpoint left it
+    simtime_t time = std::max(SIMTIME_ZERO, timeToStartSchedule - restoredTime);
+    POW_EV << "Schedule to start at " << time;
     scheduleAt(time, new cMessage("start_schedule"));
+
+    scheduleLookahead = par("scheduleLookahead").intValue();
+    if (scheduleLookahead < 1) {
+        error("scheduleLookahead must be at least 1");
+    }
+    churnRate = par("churnRate").doubleValue();
+    meanOfflineTime = par("meanOfflineTime").doubleValue();
+    if (churnRate > 0) {
+        // nodes the schedule keeps offline stay candidates, churn() skips them while they are offline
+        int count = par("count").intValue();
+        for (int i = 0; i < count; ++i) {
+            if (!checkpoint || checkpoint->getChurnedNodes().count(i) == 0) {
+                churnCandidates.push_back(i);
+            }
+        }
+        POW_EV << "Churn of " << churnRate << " nodes per hour starting at " << time << std::endl;
+        scheduleAt(time + exponential(3600 / churnRate), new cMessage("churn"));
+    }
+    if (checkpoint) {
+        // nodes churn had taken offline are restored offline, bring them back when their offline time runs out
+        for (const auto &churned : checkpoint->getChurnedNodes()) {
+            scheduleRejoin(churned.first, churned.second);
+        }
+    }
+    simtime_t checkpointTime = par("checkpointTime").doubleValue();
+    if (checkpointTime >= SIMTIME_ZERO) {
+        scheduleAt(checkpointTime, new cMessage("checkpoint"));
+    }
 }
 
 void POWScheduler::handleMessage(cMessage *msg) {
     std::string msgName = msg->getName();
     if (msgName == "start_schedule") {
-        bubble("Starting schedule");
-        EV << "Starting schedule." << std::endl;
-        std::ifstream fileReader(par("scheduleFileName").stringValue());
-        if (fileReader) {
-            for (std::string line; std::getline(fileReader, line);) {
-                // schedule syntax: timeToSend nodeAddress messageType messageParams
-                // messageParams is value,value,value
-                // each schedule message has its expected order and number of parameters
-                cStringTokenizer tok(line.c_str(), " ");
-                int time = std::stoi(tok.nextToken());
-                int address = std::stoi(tok.nextToken());
-                std::string messageType = tok.nextToken();
-                std::vector<int> parameters;
-                if (tok.hasMoreTokens()) {
-                    parameters = cStringTokenizer(tok.nextToken(), ",").asIntVector();
-                }
-                auto msg = new SchedulerMessage(std::move(messageType).c_str());
-                msg->setParameters(parameters);
-                EV << "Scheduling message to be sent to " << address
-                        << " in " << time << "s" << std::endl;
-                sendDelayed(msg, simTime() + time, "toNodes", address);
-            }
-        }
+        startSchedule();
+    } else if (msgName == "refill_schedule") {
+        refillSchedule();
+    } else if (msgName == "churn") {
+        churn();
+    } else if (msgName == "rejoin") {
+        rejoin(check_and_cast<SchedulerMessage*>(msg));
+    } else if (msgName == "checkpoint") {
+        writeCheckpoint();
     }
     delete msg;
 }
+
+void POWScheduler::startSchedule() {
+    POW_BUBBLE("Starting schedule");
+    POW_EV << "Starting schedule." << std::endl;
+    scheduleReader = ScheduleReader::open(par("scheduleFileName").stdstringValue());
+    if (!scheduleReader) {
+        POW_EV_WARN << "Could not open schedule file " << par("scheduleFileName").stringValue() << std::endl;
+        return;
+    }
+    // events have always been sent with a delay of simTime() + time at the start of the schedule, so keep the same arrival times
+    scheduleOrigin = 2 * timeToStartSchedule - restoredTime;
+    refillSchedule();
+}
+
+void POWScheduler::refillSchedule() {
+    ScheduleEvent event;
+    int sent = 0;
+    simtime_t lastEventTime = simTime();
+    while (sent < scheduleLookahead && scheduleReader->next(event)) {
+        simtime_t eventTime = scheduleOrigin + event.time;
+        if (eventTime < SIMTIME_ZERO) {
+            // sent before the restored checkpoint was taken
+            continue;
+        }
+        if (eventTime < simTime()) {
+            POW_EV_WARN << "Schedule event at " << event.time << "s is out of order.  Sending it now." << std::endl;
+            eventTime = simTime();
+        }
+        auto msg = new SchedulerMessage(event.type.c_str());
+        msg->setParameters(event.parameters);
+        POW_EV << "Scheduling message to be sent to " << event.address
+                << " at " << eventTime << "s" << std::endl;
+        sendDelayed(msg, eventTime - simTime(), "toNodes", event.address);
+        lastEventTime = eventTime;
+        ++sent;
+    }
+    if (sent == scheduleLookahead) {
+        // more events may remain, read them once the window has been used up
+        scheduleAt(lastEventTime, new cMessage("refill_schedule"));
+    } else {
+        POW_EV << "End of schedule reached." << std::endl;
+        scheduleReader.reset();
+    }
+}
+
+void POWScheduler::churn() {
+    // only take online nodes, a node the schedule took offline has to stay offline until the schedule brings it back
+    std::vector<int> online;
+    for (size_t i = 0; i < churnCandidates.size(); ++i) {
+        if (isNodeOnline(churnCandidates[i])) {
+            online.push_back(i);
+        }
+    }
+    if (!online.empty()) {
+        int candidate = online[intuniform(0, online.size() - 1)];
+        int address = churnCandidates[candidate];
+        churnCandidates[candidate] = churnCandidates.back();
+        churnCandidates.pop_back();
+
+        simtime_t offlineTime = exponential(meanOfflineTime);
+        POW_EV << "Churn: node " << address << " going offline for " << offlineTime << "s" << std::endl;
+        send(new SchedulerMessage(SCHEDULER_MESSAGE_NODE_LEAVE), "toNodes", address);
+        scheduleRejoin(address, offlineTime);
+    }
+    scheduleAt(simTime() + exponential(3600 / churnRate), new cMessage("churn"));
+}
+
+void POWScheduler::scheduleRejoin(int address, simtime_t offlineTime) {
+    auto rejoinMsg = new SchedulerMessage("rejoin");
+    rejoinMsg->setParameters(std::vector<int>{address});
+    scheduleAt(simTime() + offlineTime, rejoinMsg);
+    rejoinTimes[address] = simTime() + offlineTime;
+}
+
+void POWScheduler::rejoin(SchedulerMessage *msg) {
+    int address = msg->getParameters()[0];
+    rejoinTimes.erase(address);
+    if (isNodeOnline(address)) {
+        POW_EV << "Churn: node " << address << " was already brought back online by the schedule" << std::endl;
+    } else {
+        POW_EV << "Churn: node " << address << " coming back online" << std::endl;
+        send(new SchedulerMessage(SCHEDULER_MESSAGE_NODE_JOIN), "toNodes", address);
+    }
+    churnCandidates.push_back(address);
+}
+
+bool POWScheduler::isNodeOnline(int address) {
+    // nodes in other partitions are placeholders without parameters, assume those are online
+    cModule *node = getParentModule()->getSubmodule("node", address);
+    return node->isPlaceholder() || node->par("online").boolValue();
+}
+
+void POWScheduler::writeCheckpoint() {
+    // checkpoint times accumulate over restores, so the schedule can be continued from a checkpoint of a restored run
+    Checkpoint checkpoint((restoredTime + simTime()).dbl());
+    int count = par("count").intValue();
+    for (int i = 0; i < count; ++i) {
+        cModule *node = getParentModule()->getSubmodule("node", i);
+        if (node->isPlaceholder()) {
+            error("node %d is in another partition.  Checkpoints can't be taken in a parallel simulation", i);
+        }
+        CheckpointWriter writer;
+        check_and_cast<POWNode*>(node)->writeCheckpoint(writer);
+        checkpoint.addNode(i, writer);
+    }
+    for (const auto &rejoinTime : rejoinTimes) {
+        checkpoint.addChurnedNode(rejoinTime.first, (rejoinTime.second - simTime()).dbl());
+    }
+    std::string fileName = par("checkpointFile").stdstringValue();
+    checkpoint.write(fileName);
+    POW_EV << "Wrote checkpoint of " << count << " nodes to " << fileName << std::endl;
+}
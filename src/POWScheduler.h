@@ -17,19 +17,78 @@
 #define POWSCHEDULER_H_
 
 #include <omnetpp.h>
+#include <map>
+#include <memory>
+#include <vector>
+#include "messages/scheduler_message_m.h"
+#include "schedule_reader.h"
 
 using namespace omnetpp;
 
+/*! Sends simulation events (block creation, transactions, node churn) to the nodes of a POWNetwork.
+ * Events are read from a schedule file, and node churn can also be generated at a given rate.
+ */
 class POWScheduler: public cSimpleModule {
 public:
     static constexpr const char *SCHEDULER_MESSAGE_NEW_BLOCK = "schedulenewblock";
     static constexpr const char *SCHEDULER_MESSAGE_TX = "schedulenewtx";
+    static constexpr const char *SCHEDULER_MESSAGE_NODE_LEAVE = "schedulenodeleave";
+    static constexpr const char *SCHEDULER_MESSAGE_NODE_JOIN = "schedulenodejoin";
 
     POWScheduler();
     virtual ~POWScheduler();
 protected:
     virtual void initialize() override;
     virtual void handleMessage(cMessage *msg) override;
+private:
+    /*! Open the schedule file and send its first window of events.
+     *
+     */
+    void startSchedule();
+
+    /*! Send the next scheduleLookahead events of the schedule file to their nodes, then schedule the next refill
+     * for the time of the last event sent.  Keeps the number of pending schedule events bounded regardless of the size of the schedule file.
+     */
+    void refillSchedule();
+
+    /*! Take a random online node offline and schedule its return.  Nodes that are offline, e.g. because the schedule took
+     * them offline, are not picked, so churn never brings back a node the schedule keeps offline.  Reschedules itself according to churnRate.
+     *
+     */
+    void churn();
+
+    /*! Schedule the return of a node taken offline by churn.
+     * \param address Index of the node.
+     * \param offlineTime Time until the node comes back online.
+     */
+    void scheduleRejoin(int address, simtime_t offlineTime);
+
+    /*! Bring a node taken offline by churn back online.
+     * \param msg Self message carrying the index of the node.
+     */
+    void rejoin(SchedulerMessage *msg);
+
+    /*! Check the online parameter of a node.  Nodes in other partitions of a parallel simulation are assumed online.
+     * \param address Index of the node.
+     * \returns True if the node is online.
+     */
+    bool isNodeOnline(int address);
+
+    /*! Write a checkpoint of every node to the checkpointFile parameter.  All nodes have to be in this partition.
+     *
+     */
+    void writeCheckpoint();
+
+    std::unique_ptr<ScheduleReader> scheduleReader;
+    simtime_t scheduleOrigin; // schedule event times are relative to this
+    int timeToStartSchedule;
+    simtime_t restoredTime; // time the restored checkpoint was taken at in its own run, 0 for a normal start
+    int scheduleLookahead;
+    double churnRate; // node departures per simulated hour
+    double meanOfflineTime;
+    // nodes not currently offline because of churn.  order does not matter, so removal is a swap with the last element
+    std::vector<int> churnCandidates;
+    std::map<int, simtime_t> rejoinTimes; // time each node taken offline by churn comes back online, saved in checkpoints
 };
 
 Define_Module(POWScheduler)
@@ -0,0 +1,106 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#include "POWWorkloadGenerator.h"
+#include <algorithm>
+#include <numeric>
+#include "checkpoint.h"
+#include "messages/scheduler_message_m.h"
+#include "POWScheduler.h"
+#include "pow_logging.h"
+
+POWWorkloadGenerator::POWWorkloadGenerator() : txTimer(nullptr), blockTimer(nullptr) {
+
+}
+
+POWWorkloadGenerator::~POWWorkloadGenerator() {
+    cancelAndDelete(txTimer);
+    cancelAndDelete(blockTimer);
+}
+
+void POWWorkloadGenerator::initialize() {
+    std::string restoreFile = par("restoreCheckpoint").stdstringValue();
+    simtime_t restoredTime = restoreFile.empty() ? SIMTIME_ZERO : simtime_t(Checkpoint::load(restoreFile).getTime());
+    // a restored run is already past the start of the workload if the checkpoint was taken after it
+    simtime_t start = std::max(SIMTIME_ZERO, par("timeToStartWorkload").intValue() - restoredTime);
+    txRate = par("txRate").doubleValue();
+    meanBlockInterval = par("meanBlockInterval").doubleValue();
+    txReceiver = &par("txReceiver");
+    txAmount = &par("txAmount");
+
+    txSenders = cStringTokenizer(par("txSenders").stringValue()).asIntVector();
+    if (txSenders.empty()) {
+        txSenders.resize(par("count").intValue());
+        std::iota(txSenders.begin(), txSenders.end(), 0);
+    }
+
+    miners = cStringTokenizer(par("miners").stringValue()).asIntVector();
+    std::vector<double> hashrates = cStringTokenizer(par("minerHashrates").stringValue()).asDoubleVector();
+    if (hashrates.empty()) {
+        hashrates.assign(miners.size(), 1);
+    } else if (hashrates.size() != miners.size()) {
+        error("minerHashrates must have one entry per miner");
+    }
+    std::partial_sum(hashrates.begin(), hashrates.end(), std::back_inserter(cumulativeHashrates));
+
+    if (txRate > 0) {
+        txTimer = new cMessage("generate_tx");
+        scheduleAt(start + exponential(1 / txRate), txTimer);
+    }
+    if (meanBlockInterval > 0) {
+        if (miners.empty()) {
+            error("block generation needs at least one miner");
+        }
+        blockTimer = new cMessage("generate_block");
+        scheduleAt(start + exponential(meanBlockInterval), blockTimer);
+    }
+}
+
+void POWWorkloadGenerator::handleMessage(cMessage *msg) {
+    if (msg == txTimer) {
+        generateTx();
+    } else if (msg == blockTimer) {
+        generateBlock();
+    } else {
+        delete msg;
+    }
+}
+
+void POWWorkloadGenerator::generateTx() {
+    int sender = txSenders[intuniform(0, txSenders.size() - 1)];
+    int receiver = txReceiver->intValue();
+    int amount = txAmount->intValue();
+    auto msg = new SchedulerMessage(POWScheduler::SCHEDULER_MESSAGE_TX);
+    msg->setParameters(std::vector<int>{receiver, amount});
+    POW_EV_DETAIL << "Generated transaction of " << amount << " from " << sender << " to " << receiver << std::endl;
+    send(msg, "toNodes", sender);
+    scheduleAt(simTime() + exponential(1 / txRate), txTimer);
+}
+
+void POWWorkloadGenerator::generateBlock() {
+    int miner = selectMiner();
+    POW_EV << "Generated block for miner " << miner << std::endl;
+    send(new SchedulerMessage(POWScheduler::SCHEDULER_MESSAGE_NEW_BLOCK), "toNodes", miner);
+    scheduleAt(simTime() + exponential(meanBlockInterval), blockTimer);
+}
+
+int POWWorkloadGenerator::selectMiner() {
+    double choice = uniform(0, cumulativeHashrates.back());
+    auto chosen = std::upper_bound(cumulativeHashrates.begin(), cumulativeHashrates.end(), choice);
+    if (chosen == cumulativeHashrates.end()) {
+        --chosen;
+    }
+    return miners[chosen - cumulativeHashrates.begin()];
+}
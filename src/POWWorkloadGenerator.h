@@ -0,0 +1,66 @@
+//
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU Lesser General Public License as published by
+// the Free Software Foundation, either version 3 of the License, or
+// (at your option) any later version.
+// 
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU Lesser General Public License for more details.
+// 
+// You should have received a copy of the GNU Lesser General Public License
+// along with this program.  If not, see http://www.gnu.org/licenses/.
+// 
+
+#ifndef POWWORKLOADGENERATOR_H_
+#define POWWORKLOADGENERATOR_H_
+
+#include <omnetpp.h>
+#include <vector>
+
+using namespace omnetpp;
+
+/*! Generates transactions and blocks on the fly, as an alternative to listing them in the schedule file.
+ * Transactions arrive as a poisson process with rate txRate, each sent by a random node of txSenders to the node given by
+ * txReceiver for the amount given by txAmount.  Blocks are created with exponentially distributed intervals by a miner
+ * chosen in proportion to its hashrate.  Events are sent to nodes as the same scheduler messages POWScheduler uses.
+ */
+class POWWorkloadGenerator: public cSimpleModule {
+public:
+    POWWorkloadGenerator();
+    virtual ~POWWorkloadGenerator();
+protected:
+    virtual void initialize() override;
+    virtual void handleMessage(cMessage *msg) override;
+private:
+    /*! Send a new transaction request to a random sender and schedule the next one.
+     *
+     */
+    void generateTx();
+
+    /*! Send a new block request to a miner chosen by hashrate and schedule the next one.
+     *
+     */
+    void generateBlock();
+
+    /*! Choose a miner with probability proportional to its hashrate.
+     * \returns Index of the chosen miner's node.
+     */
+    int selectMiner();
+
+    cMessage *txTimer;
+    cMessage *blockTimer;
+    double txRate;
+    double meanBlockInterval;
+    std::vector<int> txSenders;
+    std::vector<int> miners;
+    // running sum of miner hashrates, in the same order as miners
+    std::vector<double> cumulativeHashrates;
+    cPar *txReceiver;
+    cPar *txAmount;
+};
+
+Define_Module(POWWorkloadGenerator)
+
+#endif /* POWWORKLOADGENERATOR_H_ */
@@ -8,7 +8,6 @@
 #include "addr_manager.h"
 #include <algorithm>
 #include <cmath>
-#include <omnetpp.h>
 
 std::vector<int> AddrManager::getRandomAddresses(int n) {
     // algorithm: shuffle addresses, then return subvector of length numRandomAddresses
@@ -8,95 +8,211 @@
 #ifndef BLOCKCHAIN_BLOCK_H_
 #define BLOCKCHAIN_BLOCK_H_
 
-#include <omnetpp.h>
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <iostream>
+#include <sstream>
+#include <map>
+#include <set>
 #include <vector>
+#include <cstring>
 #include "tx.h"
+#include "sha256.h"
+#include "merkle.h"
+
+namespace omnetpp {
+class cCommBuffer; // only needed for the parallel simulation packing friends, so the chain types build without OMNeT++
+}
 
 typedef std::vector<Transaction>::size_type txs_size;
 
 struct BlockHeader {
     static const int64_t NULL_HASH = 0;
+    static constexpr int SERIALIZED_SIZE = 80; // BTC's fixed size header encoding
 
     int64_t hash;
     int64_t parentHash;
+    Hash256 merkleRoot; // commits to the transactions of the block
     txs_size numTx;
     int creationTime;
+    double difficulty; // expected number of hashes needed to find this block
+
+    BlockHeader() : hash(NULL_HASH), parentHash(NULL_HASH), merkleRoot(), numTx(0), creationTime(-1), difficulty(0) {}
+
+    /*! Canonical 80 byte serialization the block identifier is computed from, laid out as BTC's header:
+     * version, parent hash, Merkle root, time, difficulty (in place of the compact target) and nonce.
+     */
+    std::string serialize() const {
+        std::string out;
+        appendLittleEndian(out, 1, 4); // version
+        appendHashField(out, parentHash);
+        out.append(merkleRoot.begin(), merkleRoot.end());
+        appendLittleEndian(out, (uint32_t)creationTime, 4);
+        float compactDifficulty = (float)difficulty;
+        uint32_t difficultyBits;
+        std::memcpy(&difficultyBits, &compactDifficulty, sizeof(difficultyBits));
+        appendLittleEndian(out, difficultyBits, 4);
+        appendLittleEndian(out, 0, 4); // nonce.  proof of work is not simulated
+        return out;
+    }
 
-    BlockHeader() : hash(NULL_HASH), parentHash(NULL_HASH), numTx(0), creationTime(-1) {}
+    /*! Identifier of the block, from the double SHA-256 of its serialized header.
+     */
+    int64_t computeHash() const {
+        std::string serialized = serialize();
+        return identifierOf(sha256::doubleHash(serialized.data(), serialized.size()));
+    }
 
     friend std::istream &operator>>(std::istream &input, BlockHeader &header) {
-        input >> header.hash >> header.parentHash >> header.numTx >> header.creationTime;
+        std::string merkleRoot;
+        input >> header.hash >> header.parentHash >> merkleRoot >> header.numTx >> header.creationTime >> header.difficulty;
+        for (size_t i = 0; i < header.merkleRoot.size() && 2 * i + 1 < merkleRoot.size(); ++i) {
+            header.merkleRoot[i] = std::stoi(merkleRoot.substr(2 * i, 2), nullptr, 16);
+        }
         return input;
     }
 
     friend std::ostream &operator<<(std::ostream &output, const BlockHeader &header) {
-        output << header.hash << header.parentHash << header.numTx << header.creationTime;
+        output << header.hash << header.parentHash << header.merkleRootHex() << header.numTx << header.creationTime << header.difficulty;
         return output;
     }
+
+    std::string merkleRootHex() const {
+        static const char digits[] = "0123456789abcdef";
+        std::string hex;
+        for (uint8_t byte : merkleRoot) {
+            hex.push_back(digits[byte >> 4]);
+            hex.push_back(digits[byte & 0xf]);
+        }
+        return hex;
+    }
+};
+
+/*! A block filtered for a light node: its header, and the transactions the node asked for with a proof that each is in
+ * the block.  The transactions are checked with MerkleProof::verify against the Merkle root of the header.
+ */
+struct MerkleBlock {
+    BlockHeader header;
+    std::vector<Transaction> transactions;
+    std::vector<MerkleProof> proofs; // proofs[i] is the proof of transactions[i]
+
+    /*! Size on the wire: the header, the number of transactions in the block, then each matched transaction and its proof.
+     */
+    int64_t serializedSize() const {
+        int64_t size = BlockHeader::SERIALIZED_SIZE + 4 + compactSizeLength(transactions.size());
+        for (txs_size i = 0; i < transactions.size(); ++i) {
+            size += transactions[i].serializedSize() + proofs[i].serializedSize();
+        }
+        return size;
+    }
 };
 
 class Block {
 public:
-    Block() {}
+    Block() : idsStale(false), serializedSizeCache(-1) {}
+
+    /*! Block with the given header and no transactions.  The header's numTx is reset, and counts the transactions added with addTransaction.
+     */
+    explicit Block(const BlockHeader &header) : header(header), idsStale(false), serializedSizeCache(-1) {
+        this->header.numTx = 0;
+    }
 
     friend std::istream &operator>>(std::istream &input, Block &block) {
+        block.serializedSizeCache = -1;
+        block.idsStale = false;
+        block.merkleTree = MerkleTree();
         input >> block.header;
         for (txs_size i = 0; i < block.header.numTx; ++i) {
             Transaction temp;
             input >> temp;
+            block.txOrder.push_back(temp.hash);
             block.transactions.insert(std::make_pair(temp.hash, temp));
         }
         return input;
     }
 
     friend std::ostream &operator<<(std::ostream &output, const Block &block) {
-        output << block.header;
-        for (auto tx : block.transactions) {
-            output << tx.second;
+        output << block.getHeader();
+        for (int64_t txHash : block.txOrder) {
+            output << block.transactions.at(txHash);
         }
         return output;
     }
 
+    /*! The block header.  The Merkle root and hash are brought up to date first if transactions were added since they were
+     * last computed.
+     */
     BlockHeader getHeader() const {
+        if (idsStale) {
+            updateIds();
+        }
         return header;
     }
 
+    /*! Add a transaction after the ones already in the block.  A transaction that is already in the block is not added again.
+     */
     void addTransaction(const Transaction &tx) {
-        transactions[tx.hash] = tx;
+        if (!transactions.insert(std::make_pair(tx.hash, tx)).second) {
+            return;
+        }
+        txOrder.push_back(tx.hash);
         header.numTx++;
+        idsStale = true;
+        serializedSizeCache = -1;
     }
 
-    static Block create(int miner, int coinbaseHash, int reward, int64_t parentHash, int time) {
+    /*! Size of this block in BTC's wire encoding.
+     * Computed once and cached, since the same block is relayed to many peers.
+     */
+    int64_t serializedSize() const {
+        if (serializedSizeCache < 0) {
+            serializedSizeCache = BlockHeader::SERIALIZED_SIZE + compactSizeLength(transactions.size());
+            for (const auto &txPair : transactions) {
+                serializedSizeCache += txPair.second.serializedSize();
+            }
+        }
+        return serializedSizeCache;
+    }
+
+    /*! Create a block holding only its coinbase transaction.
+     * \param miner Index of the node creating the block, which is paid the reward.
+     * \param height Height of the block, put in the coinbase (as BIP 34 does) so coinbases of the same miner have different identifiers.
+     * \param reward Value of the coinbase output.
+     * \param parentHash Hash of the parent block.
+     * \param time Creation time, in seconds.
+     * \param difficulty Difficulty of the block.
+     */
+    static Block create(int miner, int height, int reward, int64_t parentHash, int time, double difficulty) {
         Block result;
         result.header.creationTime = time;
+        result.header.difficulty = difficulty;
         result.header.parentHash = parentHash;
-        result.header.hash = parentHash + 1;
-        result.header.numTx = 1;
         Transaction coinbase;
         TransactionInput txIn;
         txIn.prevTxHash = TransactionInput::COINBASE_HASH;
         txIn.prevTxN = TransactionInput::COINBASE_N;
-        txIn.signature = 0;
+        txIn.signature = height;
         coinbase.inputs.push_back(txIn);
         TransactionOutput txOut;
         txOut.publicKey = miner * 2;
         txOut.value = reward;
         coinbase.outputs.push_back(txOut);
-        coinbase.hash = coinbaseHash;
-        result.transactions[coinbaseHash] = coinbase;
+        coinbase.hash = coinbase.computeHash();
+        result.addTransaction(coinbase);
         return result;
     }
 
     std::string to_string() const {
+        BlockHeader current = getHeader();
         std::stringstream strBuf;
         strBuf << "Block header: " << std::endl <<
-                "\tHash = " << header.hash << std::endl <<
-                "\tParent hash = " << header.parentHash << std::endl <<
-                "\tCreation time = " << header.creationTime << std::endl <<
-                "\tNum tx = " << header.numTx << std::endl <<
+                "\tHash = " << current.hash << std::endl <<
+                "\tParent hash = " << current.parentHash << std::endl <<
+                "\tMerkle root = " << current.merkleRootHex() << std::endl <<
+                "\tCreation time = " << current.creationTime << std::endl <<
+                "\tDifficulty = " << current.difficulty << std::endl <<
+                "\tNum tx = " << current.numTx << std::endl <<
                 "Transactions:" << std::endl;
         for (auto txPair : transactions) {
             strBuf << "\tInputs:" << std::endl;
@@ -115,9 +231,100 @@ public:
     }
 
     std::map<int64_t, Transaction> getTx() const { return transactions; }
+
+    /*! Number of transaction inputs in the block, which is the number of signatures checked to validate it.
+     *
+     */
+    size_t numInputs() const {
+        size_t count = 0;
+        for (const auto &txPair : transactions) {
+            count += txPair.second.inputs.size();
+        }
+        return count;
+    }
+
+    /*! Transactions in block order (coinbase first), which is the order of the Merkle tree leaves.
+     */
+    std::vector<Transaction> getOrderedTx() const {
+        std::vector<Transaction> ordered;
+        ordered.reserve(txOrder.size());
+        for (int64_t txHash : txOrder) {
+            ordered.push_back(transactions.at(txHash));
+        }
+        return ordered;
+    }
+
+    /*! Proof that a transaction is in this block, which a node holding only the header can check with
+     * MerkleProof::verify(tx.computeDigest(), header.merkleRoot).
+     * \param txHash Identifier of the transaction.
+     * \returns The proof, or an empty proof if the transaction is not in the block.
+     */
+    MerkleProof proveTransaction(int64_t txHash) const {
+        auto txIt = std::find(txOrder.begin(), txOrder.end(), txHash);
+        if (txIt == txOrder.end()) {
+            return MerkleProof();
+        }
+        extendMerkleTree();
+        return merkleTree.proof(txIt - txOrder.begin());
+    }
+
+    /*! The block as sent to a light node (BTC's merkleblock): the header, and the transactions matching the filter with a
+     * proof of each.
+     * \param publicKeys Filter loaded by the light node, see Transaction::matchesFilter.
+     */
+    MerkleBlock filter(const std::set<int> &publicKeys) const;
+
+    friend void doParsimPacking(omnetpp::cCommBuffer *buffer, const Block &block);
+    friend void doParsimUnpacking(omnetpp::cCommBuffer *buffer, Block &block);
 private:
-    BlockHeader header;
+    /*! Append the transactions added since the Merkle tree was last extended to it.  Their leaves are hashed as one batch.
+     */
+    void extendMerkleTree() const {
+        if (merkleTree.size() == txOrder.size()) {
+            return;
+        }
+        std::vector<std::string> serialized;
+        serialized.reserve(txOrder.size() - merkleTree.size());
+        for (auto txIt = txOrder.begin() + merkleTree.size(); txIt != txOrder.end(); ++txIt) {
+            serialized.push_back(transactions.at(*txIt).serialize());
+        }
+        std::vector<Hash256> leaves(serialized.size());
+        sha256::doubleHashMany(serialized, leaves.data());
+        merkleTree.append(leaves.data(), leaves.size());
+    }
+
+    /*! Bring the Merkle root and then the block hash up to date with the transactions.
+     */
+    void updateIds() const {
+        extendMerkleTree();
+        header.merkleRoot = merkleTree.root();
+        header.hash = header.computeHash();
+        idsStale = false;
+    }
+
+    // the Merkle root and hash are computed when the header is next read, so building a block only hashes it once
+    mutable BlockHeader header;
+    // the tree only hashes the transactions added since it was last read.  blocks received whole build it when a proof is
+    // first asked for, as their header already holds the root
+    mutable MerkleTree merkleTree;
     std::map<int64_t, Transaction> transactions;
+    std::vector<int64_t> txOrder; // hashes of the transactions in the order they were added
+    mutable bool idsStale; // transactions were added since the Merkle root and hash were computed
+    mutable int64_t serializedSizeCache; // -1 until serializedSize is first called
 };
 
+inline MerkleBlock Block::filter(const std::set<int> &publicKeys) const {
+    MerkleBlock result;
+    result.header = getHeader();
+    extendMerkleTree();
+    for (txs_size i = 0; i < txOrder.size(); ++i) {
+        const Transaction &tx = transactions.at(txOrder[i]);
+        if (tx.matchesFilter(publicKeys)) {
+            result.transactions.push_back(tx);
+            result.proofs.push_back(merkleTree.proof(i));
+        }
+    }
+    return result;
+}
+
 #endif /* BLOCKCHAIN_BLOCK_H_ */
@@ -11,7 +11,7 @@
 
 namespace fs = boost::filesystem;
 
-Blockchain::Blockchain(blocks_size blocksPerFile) : blocksPerFile(blocksPerFile) {
+Blockchain::Blockchain(blocks_size blocksPerFile) : numPruned(0), blocksPerFile(blocksPerFile), retainedBlocks(0) {
 
 }
 
@@ -47,7 +47,7 @@ Blockchain::blocks_size Blockchain::readBlocksFile(const std::string &fileName)
         for (blocks_size i = 0; i < numBlocks; ++i) {
             Block nextBlock;
             fileReader >> nextBlock;
-            blocks.push_back(nextBlock);
+            addBlock(std::move(nextBlock));
         }
     }
     return numBlocks;
@@ -55,7 +55,7 @@ Blockchain::blocks_size Blockchain::readBlocksFile(const std::string &fileName)
 
 void Blockchain::writeToDirectory(const std::string &directory) {
     blocks_size index;
-    for (index = 0; index < blocks.size() / blocksPerFile; index += blocksPerFile) {
+    for (index = 0; index < (chainHeight() - numPruned) / blocksPerFile; index += blocksPerFile) {
         std::string fileName = (fs::path(directory) / ("blocks" + std::to_string(index))).string();
         writeBlocksFile(fileName, index, index + blocksPerFile);
     }
@@ -66,56 +66,99 @@ void Blockchain::writeBlocksFile(const std::string &fileName, int start, int end
     if (fileWriter) {
         fileWriter << (end - start);
         for (int i = start; i < end; ++i) {
-            fileWriter << blocks.at(i);
+            fileWriter << bodies.at(headers.at(numPruned + i).hash);
         }
     }
 }
 
-void Blockchain::addBlock(Block &&newBlock) {
-    if (newBlock.getHeader().hash == BlockHeader::NULL_HASH) {
+AddBlockResult Blockchain::addBlock(Block &&newBlock, TipChange *change) {
+    int64_t hash = newBlock.getHeader().hash;
+    AddBlockResult result = headers.addHeader(newBlock.getHeader(), change);
+    if (result == BlockAdded || result == BlockSideBranch) {
+        bodies.emplace(hash, std::move(newBlock));
+        prune();
+    }
+    return result;
+}
+
+AddBlockResult Blockchain::addPrunedHeader(const BlockHeader &header) {
+    if (!bodies.empty()) {
+        return BlockRejected;
+    }
+    AddBlockResult result = headers.addHeader(header);
+    numPruned = headers.chainHeight();
+    headers.setMinForkHeight(numPruned);
+    return result;
+}
+
+void Blockchain::setRetainedBlocks(blocks_size retainedBlocks) {
+    this->retainedBlocks = retainedBlocks;
+    prune();
+}
+
+void Blockchain::prune() {
+    if (retainedBlocks == 0 || chainHeight() <= numPruned + retainedBlocks) {
         return;
     }
-    if (chainHeight() == 0 || getTip().getHeader().hash == newBlock.getHeader().parentHash) {
-        blocks.push_back(newBlock);
+    blocks_size keepFrom = chainHeight() - retainedBlocks;
+    if (bodies.size() > chainHeight() - numPruned) {
+        // side branches.  they are checked against the previous limit, so the bodies a reorg of this block disconnected
+        // can still be read by the caller
+        for (auto bodyIt = bodies.begin(); bodyIt != bodies.end();) {
+            if ((blocks_size)headers.branchHeightOf(bodyIt->first) < numPruned) {
+                bodyIt = bodies.erase(bodyIt);
+            } else {
+                ++bodyIt;
+            }
+        }
+    }
+    for (; numPruned < keepFrom; ++numPruned) {
+        bodies.erase(headers.at(numPruned).hash);
     }
+    // we can't switch back to blocks we no longer have
+    headers.setMinForkHeight(numPruned);
 }
 
-Block Blockchain::findBlockByHash(int64_t hash) {
-    Block blk;
+bool Blockchain::isPruned(int64_t hash) const {
     if (hash == BlockHeader::NULL_HASH) {
-        return blk;
-    }
-    auto blocksIt = std::find_if(blocks.begin(), blocks.end(), [&, hash](Block block) {
-        return block.getHeader().hash == hash;
-    });
-    if (blocksIt != blocks.end()) {
-        return *blocksIt;
-    } else {
-        return blk;
+        return prunedHeight() > 0;
     }
+    long height = headers.heightOf(hash);
+    return height >= 0 && (blocks_size)height < prunedHeight();
+}
+
+Block Blockchain::findBlockByHash(int64_t hash) {
+    auto bodyIt = bodies.find(hash);
+    return bodyIt != bodies.end() ? bodyIt->second : Block();
 }
 
 std::vector<Block> Blockchain::getBlocksAfter(int64_t hash) {
-    auto blocksIt = blocks.begin();
+    long height = 0;
     if (hash != BlockHeader::NULL_HASH) {
-        blocksIt = std::find_if(blocks.begin(), blocks.end(), [&, hash](Block block) {
-            return block.getHeader().hash == hash;
-        });
+        height = headers.heightOf(hash);
+    }
+    if (height < 0 || (blocks_size)height < prunedHeight()) {
+        return std::vector<Block>();
     }
     std::vector<Block> result;
-    std::copy(blocksIt, blocks.end(), std::back_inserter(result));
+    result.reserve(chainHeight() - height);
+    for (blocks_size i = height; i < chainHeight(); ++i) {
+        result.push_back(bodies.at(headers.at(i).hash));
+    }
     return result;
 }
 
-int64_t Blockchain::getMaxTxHash() const {
+double Blockchain::nextDifficulty(double initialDifficulty, int retargetInterval, int targetBlockInterval) const {
     if (chainHeight() == 0) {
-        return 0;
+        return initialDifficulty;
     }
-    int64_t prevMax = 0;
-    for (auto tx : getTip().getTx()) {
-        if (tx.second.hash > prevMax) {
-            prevMax = tx.second.hash;
-        }
+    const BlockHeader &tip = headers.getTip();
+    double current = tip.difficulty > 0 ? tip.difficulty : initialDifficulty;
+    if (retargetInterval <= 0 || chainHeight() % retargetInterval != 0) {
+        return current;
     }
-    return prevMax;
+    double expected = (double)retargetInterval * targetBlockInterval;
+    double actual = tip.creationTime - headers.at(chainHeight() - retargetInterval).creationTime;
+    actual = std::max(expected / 4, std::min(expected * 4, actual));
+    return current * expected / actual;
 }
@@ -9,7 +9,9 @@
 #define BLOCKCHAIN_BLOCKCHAIN_H_
 
 #include "block.h"
+#include "header_chain.h"
 #include <list>
+#include <unordered_map>
 
 class Blockchain {
 public:
@@ -23,7 +25,43 @@ public:
     static std::unique_ptr<Blockchain> emptyBlockchain(blocks_size blocksPerFile);
     void writeToDirectory(const std::string &directory);
 
-    void addBlock(Block && block);
+    /*! Add a block whose parent is known.  Blocks on side branches are kept, and the chain switches to the branch with
+     * the most work (see HeaderChain).  If the chain is pruned, bodies of blocks older than the retained ones are discarded.
+     * \param block Block to add.
+     * \param change If not nullptr, filled in with the blocks leaving and joining the active chain.  Their bodies can still
+     * be read with findBlockByHash until the next block is added.
+     * \returns Whether the block was added, and if not, why.
+     */
+    AddBlockResult addBlock(Block && block, TipChange *change = nullptr);
+
+    /*! Add a block whose body was already pruned, keeping only its header.  Used to restore a pruned chain, and only
+     * possible before any block bodies are added.
+     * \param header Header to add.  Only extends the chain if its parent is the current tip.
+     * \returns Whether the header was added, and if not, why.
+     */
+    AddBlockResult addPrunedHeader(const BlockHeader &header);
+
+    /*! Keep the headers of every block, but only the bodies of the most recent blocks.  Bodies beyond the limit are
+     * discarded right away.
+     * \param retainedBlocks Number of block bodies kept, at least 1.  0 keeps every body.
+     */
+    void setRetainedBlocks(blocks_size retainedBlocks);
+
+    blocks_size getRetainedBlocks() const {
+        return retainedBlocks;
+    }
+
+    /*! Number of blocks at the start of the chain whose bodies were discarded.
+     *
+     */
+    blocks_size prunedHeight() const {
+        return numPruned;
+    }
+
+    /*! Whether the block with the given hash, or any block after it, has had its body discarded.  NULL_HASH asks for the
+     * whole chain.
+     */
+    bool isPruned(int64_t hash) const;
 
     void setBlocksPerFile(blocks_size blocksPerFile) {
         this->blocksPerFile = blocksPerFile;
@@ -33,34 +71,72 @@ public:
         return blocksPerFile;
     }
 
+    /*! Get a block of any branch.
+     * \returns The block, or an empty block if it is not known or its body was discarded.
+     */
     Block findBlockByHash(int64_t hash);
 
-    int64_t getMaxTxHash() const;
+    /*! Whether the block with the given hash is known, on any branch, even if its body was pruned.
+     *
+     */
+    bool contains(int64_t hash) const {
+        return headers.contains(hash);
+    }
 
-    /*! Get the blocks after and including the block with the given hash
+    /*! Headers of every known block, including the ones on side branches.
      *
      */
+    const HeaderChain &getHeaders() const {
+        return headers;
+    }
+
+    /*! Get the difficulty of the next block to be added to the chain.  The difficulty is retargeted every retargetInterval
+     * blocks so that blocks are found every targetBlockInterval seconds on average, limited to a factor of 4 per retarget as in BTC.
+     * \param initialDifficulty Difficulty of the first block.
+     * \param retargetInterval Number of blocks between retargets.
+     * \param targetBlockInterval Desired number of seconds between blocks.
+     */
+    double nextDifficulty(double initialDifficulty, int retargetInterval, int targetBlockInterval) const;
+
+    /*! Get the blocks of the active chain after and including the block with the given hash, or the whole chain for
+     * NULL_HASH.  Empty if the hash is not on the active chain or the body of the block was discarded (see isPruned).
+     */
     std::vector<Block> getBlocksAfter(int64_t hash);
 
+    /*! Get the headers of the active chain after and including the block with the given hash, or the whole chain for
+     * NULL_HASH.  Headers are kept for pruned blocks too.
+     */
+    std::vector<BlockHeader> getHeadersAfter(int64_t hash) const {
+        return headers.getHeadersAfter(hash);
+    }
+
     Block &getTip() {
-        return blocks[blocks.size() - 1];
+        return bodies.at(headers.getTip().hash);
     }
 
     const Block &getTip() const {
-        return blocks[blocks.size() - 1];
+        return bodies.at(headers.getTip().hash);
     }
 
     size_t chainHeight() const {
-        return blocks.size();
+        return headers.chainHeight();
     }
 
 private:
     blocks_size readBlocksFile(const std::string &fileName);
     void writeBlocksFile(const std::string &fileName, int start, int end);
 
+    /*! Discard the bodies of the blocks older than the retained ones, on any branch.
+     *
+     */
+    void prune();
+
     explicit Blockchain(blocks_size blocksPerFile);
-    std::vector<Block> blocks;
+    HeaderChain headers; // every known block, on any branch
+    std::unordered_map<int64_t, Block> bodies; // bodies of the blocks that weren't pruned, on any branch
+    blocks_size numPruned; // blocks at the start of the active chain whose bodies were discarded
     blocks_size blocksPerFile;
+    blocks_size retainedBlocks;
 };
 
 #endif /* BLOCKCHAIN_BLOCKCHAIN_H_ */
@@ -0,0 +1,82 @@
+/*
+ * header_chain.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "header_chain.h"
+
+namespace {
+
+/*! Work of a header, as the expected number of hashes needed to find it.  Headers without a difficulty count as 1, so
+ * chains of them are compared by length.
+ */
+double headerWork(const BlockHeader &header) {
+    return header.difficulty > 0 ? header.difficulty : 1;
+}
+
+}
+
+AddBlockResult HeaderChain::addHeader(const BlockHeader &header, TipChange *change) {
+    if (header.hash == BlockHeader::NULL_HASH || header.hash != header.computeHash()) {
+        return BlockRejected;
+    }
+    if (entries.find(header.hash) != entries.end()) {
+        return BlockKnown;
+    }
+    Entry entry{header, 0, headerWork(header)};
+    if (!entries.empty()) {
+        auto parentIt = entries.find(header.parentHash);
+        if (parentIt == entries.end()) {
+            return BlockOrphan;
+        }
+        entry.height = parentIt->second.height + 1;
+        entry.chainWork += parentIt->second.chainWork;
+    }
+    const Entry &added = entries.emplace(header.hash, entry).first->second;
+    if (!active.empty() && added.chainWork <= entries.at(active.back()).chainWork) {
+        return BlockSideBranch;
+    }
+    // walk back to the active chain.  the first header has no parent and is only added to an empty chain
+    std::vector<int64_t> branch;
+    for (const Entry *current = &added; !onActiveChain(*current); current = &entries.at(current->header.parentHash)) {
+        branch.push_back(current->header.hash);
+        if (current->height == 0) {
+            break;
+        }
+    }
+    headers_size forkHeight = entries.at(branch.back()).height;
+    if (forkHeight < active.size() && forkHeight < minForkHeight) {
+        return BlockSideBranch;
+    }
+    if (change) {
+        change->disconnected.assign(active.rbegin(), active.rend() - forkHeight);
+        change->connected.assign(branch.rbegin(), branch.rend());
+    }
+    active.resize(forkHeight);
+    active.insert(active.end(), branch.rbegin(), branch.rend());
+    return BlockAdded;
+}
+
+const BlockHeader *HeaderChain::find(int64_t hash) const {
+    auto entryIt = entries.find(hash);
+    return entryIt != entries.end() && onActiveChain(entryIt->second) ? &entryIt->second.header : nullptr;
+}
+
+std::vector<BlockHeader> HeaderChain::getHeadersAfter(int64_t hash) const {
+    headers_size start = 0;
+    if (hash != BlockHeader::NULL_HASH) {
+        long height = heightOf(hash);
+        if (height < 0) {
+            return std::vector<BlockHeader>();
+        }
+        start = height;
+    }
+    std::vector<BlockHeader> result;
+    result.reserve(active.size() - start);
+    for (headers_size height = start; height < active.size(); ++height) {
+        result.push_back(at(height));
+    }
+    return result;
+}
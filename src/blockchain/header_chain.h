@@ -0,0 +1,114 @@
+/*
+ * header_chain.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef BLOCKCHAIN_HEADER_CHAIN_H_
+#define BLOCKCHAIN_HEADER_CHAIN_H_
+
+#include <unordered_map>
+#include <vector>
+#include "block.h"
+
+enum AddBlockResult {
+    BlockAdded, // the block is on the active chain, which it extended or made the one with the most work
+    BlockSideBranch, // the block was kept on a branch with less work than the active chain
+    BlockKnown, // already known, on any branch
+    BlockOrphan, // the parent of the block is not known
+    BlockRejected // invalid block
+};
+
+/*! Blocks that left and joined the active chain when a block was added.
+ *
+ */
+struct TipChange {
+    std::vector<int64_t> disconnected; // hashes of the blocks that left the active chain, tip first
+    std::vector<int64_t> connected; // hashes of the blocks that joined the active chain, oldest first
+};
+
+/*! Tree of block headers without the blocks, as kept by a light (SPV) node, and by Blockchain to index its blocks.  A
+ * header is only accepted if its hash is that of its contents, so the Merkle roots can be trusted to check transactions against.
+ * Headers on side branches are kept, and the active chain is the branch with the most work, as in BTC.  On a tie the
+ * branch seen first stays active.
+ */
+class HeaderChain {
+public:
+    typedef std::vector<int64_t>::size_type headers_size;
+
+    /*! Add a header to the tree.  If its branch then has more work than the active chain, the branch becomes active.
+     * \param header Header to add.  Only accepted if its parent is known, except for the first header.
+     * \param change If not nullptr, filled in with the headers leaving and joining the active chain when the header is added.
+     * \returns Whether the header was added, and if not, why.  A header whose hash doesn't match its contents is rejected.
+     */
+    AddBlockResult addHeader(const BlockHeader &header, TipChange *change = nullptr);
+
+    /*! Whether a header is known, on any branch.
+     *
+     */
+    bool contains(int64_t hash) const {
+        return entries.find(hash) != entries.end();
+    }
+
+    /*! Find a header of the active chain.
+     * \returns The header, or nullptr if it is not on the active chain.  Only valid until the next header is added.
+     */
+    const BlockHeader *find(int64_t hash) const;
+
+    /*! Get the headers of the active chain after and including the header with the given hash, or the whole chain for NULL_HASH.
+     *
+     */
+    std::vector<BlockHeader> getHeadersAfter(int64_t hash) const;
+
+    /*! Position of a header in the active chain.
+     * \returns The height, or -1 if the header is not on the active chain.
+     */
+    long heightOf(int64_t hash) const {
+        auto entryIt = entries.find(hash);
+        return entryIt != entries.end() && onActiveChain(entryIt->second) ? (long)entryIt->second.height : -1;
+    }
+
+    /*! Height of a header on its own branch, which is its number of ancestors.
+     * \returns The height, or -1 if the header is not known.
+     */
+    long branchHeightOf(int64_t hash) const {
+        auto entryIt = entries.find(hash);
+        return entryIt != entries.end() ? (long)entryIt->second.height : -1;
+    }
+
+    const BlockHeader &at(headers_size height) const {
+        return entries.at(active[height]).header;
+    }
+
+    const BlockHeader &getTip() const {
+        return at(active.size() - 1);
+    }
+
+    headers_size chainHeight() const {
+        return active.size();
+    }
+
+    /*! Stop reorganizations from replacing the headers of the active chain below the given height.  Branches forking
+     * lower are still kept, but never become active.  Used by pruned chains, which no longer have the blocks to switch back to.
+     */
+    void setMinForkHeight(headers_size height) {
+        minForkHeight = height;
+    }
+private:
+    struct Entry {
+        BlockHeader header;
+        headers_size height; // number of ancestors
+        double chainWork; // work of the header and all of its ancestors
+    };
+
+    bool onActiveChain(const Entry &entry) const {
+        return entry.height < active.size() && active[entry.height] == entry.header.hash;
+    }
+
+    std::unordered_map<int64_t, Entry> entries; // every known header, linked to its parent by parentHash
+    std::vector<int64_t> active; // hashes of the active chain, oldest first
+    headers_size minForkHeight = 0;
+};
+
+#endif /* BLOCKCHAIN_HEADER_CHAIN_H_ */
@@ -0,0 +1,122 @@
+/*
+ * merkle.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "merkle.h"
+#include "tx.h"
+
+namespace {
+
+Hash256 hashPair(const Hash256 &left, const Hash256 &right) {
+    Hash256 pair[2] = {left, right};
+    Hash256 digest;
+    sha256::doubleHashPairs(pair, 1, &digest);
+    return digest;
+}
+
+}
+
+Hash256 computeMerkleRoot(std::vector<Hash256> leaves) {
+    if (leaves.empty()) {
+        return Hash256();
+    }
+    while (leaves.size() > 1) {
+        if (leaves.size() % 2 == 1) {
+            leaves.push_back(leaves.back());
+        }
+        size_t numPairs = leaves.size() / 2;
+        sha256::doubleHashPairs(leaves.data(), numPairs, leaves.data());
+        leaves.resize(numPairs);
+    }
+    return leaves[0];
+}
+
+int64_t MerkleProof::serializedSize() const {
+    return 4 + compactSizeLength(siblings.size()) + (int64_t)siblings.size() * sizeof(Hash256);
+}
+
+bool MerkleProof::verify(const Hash256 &leaf, const Hash256 &root) const {
+    if (empty()) {
+        return false;
+    }
+    Hash256 node = leaf;
+    uint32_t position = index;
+    for (const Hash256 &sibling : siblings) {
+        node = position % 2 == 1 ? hashPair(sibling, node) : hashPair(node, sibling);
+        position /= 2;
+    }
+    // an index with more bits than the proof has levels would be accepted for a different leaf otherwise
+    return position == 0 && node == root;
+}
+
+void MerkleTree::append(const Hash256 *leaves, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    if (levels.empty()) {
+        levels.emplace_back();
+    }
+    levels[0].insert(levels[0].end(), leaves, leaves + count);
+    for (size_t level = 0; levels[level].size() >= 2; ++level) {
+        if (levels.size() == level + 1) {
+            levels.emplace_back();
+        }
+        size_t hashed = levels[level + 1].size();
+        size_t numPairs = levels[level].size() / 2;
+        if (numPairs == hashed) {
+            break;
+        }
+        levels[level + 1].resize(numPairs);
+        sha256::doubleHashPairs(&levels[level][2 * hashed], numPairs - hashed, &levels[level + 1][hashed]);
+    }
+}
+
+std::vector<Hash256> MerkleTree::edgeNodes() const {
+    std::vector<Hash256> edge(1);
+    size_t levelSize = size();
+    for (size_t level = 0; levelSize > 1; ++level) {
+        size_t parentSize = (levelSize + 1) / 2;
+        edge.emplace_back();
+        if (levels.size() <= level + 1 || levels[level + 1].size() < parentSize) {
+            // the last node of the level is paired with the one before it, or with itself if it has no sibling
+            auto node = [&](size_t i) { return i < levels[level].size() ? levels[level][i] : edge[level]; };
+            const Hash256 last = node(levelSize - 1);
+            edge[level + 1] = hashPair(levelSize % 2 == 0 ? node(levelSize - 2) : last, last);
+        }
+        levelSize = parentSize;
+    }
+    return edge;
+}
+
+Hash256 MerkleTree::root() const {
+    if (size() == 0) {
+        return Hash256();
+    }
+    std::vector<Hash256> edge = edgeNodes();
+    size_t top = edge.size() - 1;
+    return top < levels.size() && !levels[top].empty() ? levels[top][0] : edge[top];
+}
+
+MerkleProof MerkleTree::proof(size_t index) const {
+    MerkleProof result;
+    if (index >= size()) {
+        return result;
+    }
+    std::vector<Hash256> edge = edgeNodes();
+    result.index = index;
+    size_t position = index;
+    size_t levelSize = size();
+    for (size_t level = 0; levelSize > 1; ++level) {
+        size_t sibling = position ^ 1;
+        if (sibling >= levelSize) {
+            sibling = position;
+        }
+        result.siblings.push_back(sibling < levels[level].size() ? levels[level][sibling] : edge[level]);
+        position /= 2;
+        levelSize = (levelSize + 1) / 2;
+    }
+    return result;
+}
@@ -0,0 +1,87 @@
+/*
+ * merkle.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef BLOCKCHAIN_MERKLE_H_
+#define BLOCKCHAIN_MERKLE_H_
+
+#include <cstdint>
+#include <limits>
+#include <vector>
+#include "sha256.h"
+
+/*! Merkle root of the given leaves, as BTC computes it: each level is hashed in pairs, and the last node of a level with
+ * an odd number of nodes is paired with itself.  Each level is hashed as one batch.
+ * \param leaves Leaf digests, in order.
+ * \returns The root, the leaf itself for a single leaf, or all zeros for no leaves.
+ */
+Hash256 computeMerkleRoot(std::vector<Hash256> leaves);
+
+/*! Proof that a leaf is in a Merkle tree: the sibling of each node on the path from the leaf to the root.
+ */
+struct MerkleProof {
+    static constexpr uint32_t NO_INDEX = std::numeric_limits<uint32_t>::max();
+
+    uint32_t index; // position of the leaf, NO_INDEX for a proof of a leaf that isn't in the tree
+    std::vector<Hash256> siblings; // from the leaf level up
+
+    MerkleProof() : index(NO_INDEX) {}
+
+    bool empty() const {
+        return index == NO_INDEX;
+    }
+
+    /*! Size of this proof on the wire: the index, then a CompactSize count and the siblings.
+     */
+    int64_t serializedSize() const;
+
+    /*! Check the proof by hashing the leaf up to the root.
+     * \param leaf Digest of the leaf, for a transaction Transaction::computeDigest.
+     * \param root Merkle root the leaf should be under, for a block that of its header.
+     * \returns Whether the leaf is at index in the tree with that root.
+     */
+    bool verify(const Hash256 &leaf, const Hash256 &root) const;
+};
+
+/*! Merkle tree that leaves are appended to.  Only the nodes whose subtrees are complete are kept, so each node is hashed
+ * once however many leaves are appended after it.  The nodes on the right edge of the tree, which change as leaves are
+ * added, are computed when the root or a proof is asked for.  Gives the same root as computeMerkleRoot.
+ */
+class MerkleTree {
+public:
+    MerkleTree() {}
+
+    /*! Append leaves after the ones already in the tree.  The nodes they complete are hashed as one batch per level.
+     */
+    void append(const Hash256 *leaves, size_t count);
+
+    void append(const Hash256 &leaf) {
+        append(&leaf, 1);
+    }
+
+    size_t size() const {
+        return levels.empty() ? 0 : levels[0].size();
+    }
+
+    /*! The Merkle root, all zeros for an empty tree.
+     */
+    Hash256 root() const;
+
+    /*! Proof that the leaf at index is in the tree, to check against root() with MerkleProof::verify.
+     * \param index Position of the leaf.  An empty proof is returned if there is no such leaf.
+     */
+    MerkleProof proof(size_t index) const;
+
+private:
+    /*! For each level, the last node of the level if it is not complete yet (see levels), else a zero digest.
+     */
+    std::vector<Hash256> edgeNodes() const;
+
+    // levels[0] holds the leaves, and levels[k] the nodes of level k whose subtrees are complete
+    std::vector<std::vector<Hash256>> levels;
+};
+
+#endif /* BLOCKCHAIN_MERKLE_H_ */
@@ -0,0 +1,384 @@
+/*
+ * sha256.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "sha256.h"
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SHA256_X86 1
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace {
+
+const uint32_t INITIAL_STATE[8] = {
+        0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19,
+};
+
+const uint32_t K[64] = {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2,
+};
+
+const size_t BLOCK_SIZE = 64;
+
+typedef std::array<uint32_t, 8> State;
+
+inline uint32_t loadBigEndian(const uint8_t *bytes) {
+    return (uint32_t)bytes[0] << 24 | (uint32_t)bytes[1] << 16 | (uint32_t)bytes[2] << 8 | bytes[3];
+}
+
+inline void storeBigEndian(uint32_t value, uint8_t *bytes) {
+    bytes[0] = value >> 24;
+    bytes[1] = value >> 16;
+    bytes[2] = value >> 8;
+    bytes[3] = value;
+}
+
+inline uint32_t rotr(uint32_t x, int n) {
+    return (x >> n) | (x << (32 - n));
+}
+
+void compressPortable(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    for (; numBlocks > 0; --numBlocks, data += BLOCK_SIZE) {
+        uint32_t w[64];
+        for (int t = 0; t < 16; ++t) {
+            w[t] = loadBigEndian(data + 4 * t);
+        }
+        for (int t = 16; t < 64; ++t) {
+            uint32_t s0 = rotr(w[t - 15], 7) ^ rotr(w[t - 15], 18) ^ (w[t - 15] >> 3);
+            uint32_t s1 = rotr(w[t - 2], 17) ^ rotr(w[t - 2], 19) ^ (w[t - 2] >> 10);
+            w[t] = w[t - 16] + s0 + w[t - 7] + s1;
+        }
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int t = 0; t < 64; ++t) {
+            uint32_t t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + K[t] + w[t];
+            uint32_t t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef SHA256_X86
+/* SHA-NI: each sha256rnds2 does two rounds on the state held as ABEF and CDGH, and sha256msg1/msg2 extend the message
+ * schedule four words at a time.
+ */
+__attribute__((target("sha,sse4.1")))
+void compressShaNi(uint32_t *state, const uint8_t *data, size_t numBlocks) {
+    const __m128i byteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[0]), 0xB1); // CDAB
+    __m128i state1 = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i *)&state[4]), 0x1B); // EFGH
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8); // ABEF
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0); // CDGH
+
+    for (; numBlocks > 0; --numBlocks, data += BLOCK_SIZE) {
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+        __m128i w[4]; // the last 16 words of the message schedule
+        for (int group = 0; group < 16; ++group) {
+            __m128i &words = w[group % 4];
+            if (group < 4) {
+                words = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(data + 16 * group)), byteSwap);
+            } else {
+                // w[t - 16] + s0(w[t - 15]) + w[t - 7], then + s1(w[t - 2])
+                __m128i next = _mm_sha256msg1_epu32(words, w[(group + 1) % 4]);
+                next = _mm_add_epi32(next, _mm_alignr_epi8(w[(group + 3) % 4], w[(group + 2) % 4], 4));
+                words = _mm_sha256msg2_epu32(next, w[(group + 3) % 4]);
+            }
+            __m128i msg = _mm_add_epi32(words, _mm_loadu_si128((const __m128i *)&K[4 * group]));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, _mm_shuffle_epi32(msg, 0x0E));
+        }
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B); // FEBA
+    state1 = _mm_shuffle_epi32(state1, 0xB1); // DCHG
+    _mm_storeu_si128((__m128i *)&state[0], _mm_blend_epi16(tmp, state1, 0xF0)); // DCBA
+    _mm_storeu_si128((__m128i *)&state[4], _mm_alignr_epi8(state1, tmp, 8)); // HGFE
+}
+
+/* AVX2: eight independent messages, one per 32 bit lane.  Vector j holds word j of the state of every message.
+ */
+#define SHA256_AVX2 __attribute__((target("avx2")))
+
+SHA256_AVX2 inline __m256i rotr8(__m256i x, int n) {
+    return _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - n));
+}
+
+SHA256_AVX2 inline __m256i add8(__m256i a, __m256i b) {
+    return _mm256_add_epi32(a, b);
+}
+
+/*! Compress numBlocks blocks of eight messages.  Message i starts at data + i * stride.
+ */
+SHA256_AVX2
+void compressAvx2(State *states, const uint8_t *data, size_t stride, size_t numBlocks) {
+    __m256i s[8];
+    for (int j = 0; j < 8; ++j) {
+        s[j] = _mm256_setr_epi32(states[0][j], states[1][j], states[2][j], states[3][j],
+                states[4][j], states[5][j], states[6][j], states[7][j]);
+    }
+    for (size_t block = 0; block < numBlocks; ++block) {
+        const uint8_t *blockData = data + block * BLOCK_SIZE;
+        __m256i w[16];
+        for (int t = 0; t < 16; ++t) {
+            const uint8_t *word = blockData + 4 * t;
+            w[t] = _mm256_setr_epi32(loadBigEndian(word), loadBigEndian(word + stride), loadBigEndian(word + 2 * stride),
+                    loadBigEndian(word + 3 * stride), loadBigEndian(word + 4 * stride), loadBigEndian(word + 5 * stride),
+                    loadBigEndian(word + 6 * stride), loadBigEndian(word + 7 * stride));
+        }
+        __m256i a = s[0], b = s[1], c = s[2], d = s[3], e = s[4], f = s[5], g = s[6], h = s[7];
+        for (int t = 0; t < 64; ++t) {
+            if (t >= 16) {
+                __m256i w15 = w[(t - 15) % 16], w2 = w[(t - 2) % 16];
+                __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w15, 7), rotr8(w15, 18)), _mm256_srli_epi32(w15, 3));
+                __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(w2, 17), rotr8(w2, 19)), _mm256_srli_epi32(w2, 10));
+                w[t % 16] = add8(add8(w[t % 16], s0), add8(w[(t - 7) % 16], s1));
+            }
+            __m256i sum1 = _mm256_xor_si256(_mm256_xor_si256(rotr8(e, 6), rotr8(e, 11)), rotr8(e, 25));
+            __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+            __m256i t1 = add8(add8(add8(h, sum1), add8(ch, _mm256_set1_epi32(K[t]))), w[t % 16]);
+            __m256i sum0 = _mm256_xor_si256(_mm256_xor_si256(rotr8(a, 2), rotr8(a, 13)), rotr8(a, 22));
+            __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+            h = g;
+            g = f;
+            f = e;
+            e = add8(d, t1);
+            d = c;
+            c = b;
+            b = a;
+            a = add8(t1, add8(sum0, maj));
+        }
+        s[0] = add8(s[0], a);
+        s[1] = add8(s[1], b);
+        s[2] = add8(s[2], c);
+        s[3] = add8(s[3], d);
+        s[4] = add8(s[4], e);
+        s[5] = add8(s[5], f);
+        s[6] = add8(s[6], g);
+        s[7] = add8(s[7], h);
+    }
+    for (int j = 0; j < 8; ++j) {
+        alignas(32) uint32_t lanes[8];
+        _mm256_store_si256((__m256i *)lanes, s[j]);
+        for (int i = 0; i < 8; ++i) {
+            states[i][j] = lanes[i];
+        }
+    }
+}
+
+bool cpuHasShaNi() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_SSE4_1)) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_SHA);
+}
+
+bool cpuHasAvx2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx) || !(ecx & bit_OSXSAVE) || !(ecx & bit_AVX)) {
+        return false;
+    }
+    // the OS has to save the AVX registers on context switches
+    uint32_t xcr0Low, xcr0High;
+    __asm__("xgetbv" : "=a"(xcr0Low), "=d"(xcr0High) : "c"(0));
+    if ((xcr0Low & 0x6) != 0x6) {
+        return false;
+    }
+    return __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx) && (ebx & bit_AVX2);
+}
+#endif
+
+struct Kernels {
+    void (*single)(uint32_t *state, const uint8_t *data, size_t numBlocks);
+    bool avx2;
+
+    void select(bool portable) {
+        single = compressPortable;
+        avx2 = false;
+#ifdef SHA256_X86
+        if (!portable) {
+            if (cpuHasShaNi()) {
+                single = compressShaNi;
+            }
+            avx2 = cpuHasAvx2();
+        }
+#endif
+    }
+
+    Kernels() {
+        select(false);
+    }
+};
+
+Kernels &kernels() {
+    static Kernels selected;
+    return selected;
+}
+
+/*! Compress count messages of numBlocks (already padded) blocks each, message i starting at data + i * stride.
+ */
+void compressMany(State *states, const uint8_t *data, size_t stride, size_t count, size_t numBlocks) {
+    const Kernels &use = kernels();
+    size_t i = 0;
+#ifdef SHA256_X86
+    if (use.avx2) {
+        for (; i + 8 <= count; i += 8) {
+            compressAvx2(states + i, data + i * stride, stride, numBlocks);
+        }
+    }
+#endif
+    for (; i < count; ++i) {
+        use.single(states[i].data(), data + i * stride, numBlocks);
+    }
+}
+
+size_t paddedBlocks(size_t size) {
+    // the data, a 0x80 byte and the 64 bit length
+    return (size + 1 + 8 + BLOCK_SIZE - 1) / BLOCK_SIZE;
+}
+
+/*! Writes the data and its padding to out, which must have room for paddedBlocks(size) blocks.
+ */
+void pad(const uint8_t *data, size_t size, uint8_t *out) {
+    size_t paddedSize = paddedBlocks(size) * BLOCK_SIZE;
+    std::memcpy(out, data, size);
+    out[size] = 0x80;
+    std::memset(out + size + 1, 0, paddedSize - size - 1);
+    uint64_t bits = (uint64_t)size * 8;
+    for (int i = 0; i < 8; ++i) {
+        out[paddedSize - 1 - i] = bits >> (8 * i);
+    }
+}
+
+void initState(State &state) {
+    std::copy(INITIAL_STATE, INITIAL_STATE + 8, state.begin());
+}
+
+void digestOf(const State &state, uint8_t *digest) {
+    for (int j = 0; j < 8; ++j) {
+        storeBigEndian(state[j], digest + 4 * j);
+    }
+}
+
+/*! Second SHA-256 of count first pass digests, in place.  Every digest is a single padded block, so they are all hashed together.
+ */
+void hashDigests(Hash256 *digests, size_t count) {
+    std::vector<uint8_t> blocks(count * BLOCK_SIZE);
+    std::vector<State> states(count);
+    for (size_t i = 0; i < count; ++i) {
+        pad(digests[i].data(), digests[i].size(), &blocks[i * BLOCK_SIZE]);
+        initState(states[i]);
+    }
+    compressMany(states.data(), blocks.data(), BLOCK_SIZE, count, 1);
+    for (size_t i = 0; i < count; ++i) {
+        digestOf(states[i], digests[i].data());
+    }
+}
+
+}
+
+namespace sha256 {
+
+Hash256 hash(const void *data, size_t size) {
+    size_t numBlocks = paddedBlocks(size);
+    std::vector<uint8_t> padded(numBlocks * BLOCK_SIZE);
+    pad(static_cast<const uint8_t *>(data), size, padded.data());
+    State state;
+    initState(state);
+    kernels().single(state.data(), padded.data(), numBlocks);
+    Hash256 digest;
+    digestOf(state, digest.data());
+    return digest;
+}
+
+Hash256 doubleHash(const void *data, size_t size) {
+    Hash256 first = hash(data, size);
+    return hash(first.data(), first.size());
+}
+
+void doubleHashMany(const std::vector<std::string> &messages, Hash256 *digests) {
+    // messages are grouped by their number of blocks, so each group can be hashed in lockstep
+    std::map<size_t, std::vector<size_t>> byBlocks;
+    for (size_t i = 0; i < messages.size(); ++i) {
+        byBlocks[paddedBlocks(messages[i].size())].push_back(i);
+    }
+    std::vector<uint8_t> padded;
+    std::vector<State> states;
+    for (const auto &group : byBlocks) {
+        size_t stride = group.first * BLOCK_SIZE;
+        const std::vector<size_t> &indices = group.second;
+        padded.resize(indices.size() * stride);
+        states.resize(indices.size());
+        for (size_t i = 0; i < indices.size(); ++i) {
+            const std::string &message = messages[indices[i]];
+            pad(reinterpret_cast<const uint8_t *>(message.data()), message.size(), &padded[i * stride]);
+            initState(states[i]);
+        }
+        compressMany(states.data(), padded.data(), stride, indices.size(), group.first);
+        for (size_t i = 0; i < indices.size(); ++i) {
+            digestOf(states[i], digests[indices[i]].data());
+        }
+    }
+    hashDigests(digests, messages.size());
+}
+
+void doubleHashPairs(const Hash256 *nodes, size_t numPairs, Hash256 *digests) {
+    const size_t pairSize = 2 * sizeof(Hash256);
+    const size_t stride = paddedBlocks(pairSize) * BLOCK_SIZE;
+    std::vector<uint8_t> padded(numPairs * stride);
+    std::vector<State> states(numPairs);
+    for (size_t i = 0; i < numPairs; ++i) {
+        pad(nodes[2 * i].data(), pairSize, &padded[i * stride]);
+        initState(states[i]);
+    }
+    compressMany(states.data(), padded.data(), stride, numPairs, stride / BLOCK_SIZE);
+    for (size_t i = 0; i < numPairs; ++i) {
+        digestOf(states[i], digests[i].data());
+    }
+    hashDigests(digests, numPairs);
+}
+
+void setPortable(bool portable) {
+    kernels().select(portable);
+}
+
+std::string implementation() {
+    const Kernels &use = kernels();
+    std::string single = use.single == compressPortable ? "portable" : "sha-ni";
+    return single + ", batches " + (use.avx2 ? "avx2 x8" : single);
+}
+
+}
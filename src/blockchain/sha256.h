@@ -0,0 +1,55 @@
+/*
+ * sha256.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef BLOCKCHAIN_SHA256_H_
+#define BLOCKCHAIN_SHA256_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+typedef std::array<uint8_t, 32> Hash256;
+
+/* SHA-256, used for block and transaction identifiers.
+ * Single messages are hashed with the SHA extensions (SHA-NI) when the CPU has them.  Batches of messages (the transactions
+ * of a block, a level of a Merkle tree) are hashed 8 at a time with AVX2 when the CPU has it.  Otherwise a portable
+ * implementation is used.  All of them give the same digests.
+ */
+namespace sha256 {
+
+Hash256 hash(const void *data, size_t size);
+
+/*! SHA-256 of the SHA-256 of the data, as BTC uses for its identifiers.
+ */
+Hash256 doubleHash(const void *data, size_t size);
+
+/*! Double SHA-256 of each message.  Messages with the same number of SHA-256 blocks are hashed together.
+ * \param messages Messages to hash.
+ * \param digests Filled in with the digest of each message.  Must have room for messages.size() digests.
+ */
+void doubleHashMany(const std::vector<std::string> &messages, Hash256 *digests);
+
+/*! Double SHA-256 of each concatenated pair of digests, as needed for a level of a Merkle tree.
+ * \param nodes 2 * numPairs digests.  Pair i is nodes[2 * i] followed by nodes[2 * i + 1].
+ * \param numPairs Number of pairs to hash.
+ * \param digests Filled in with the digest of each pair.  May be the same array as nodes.
+ */
+void doubleHashPairs(const Hash256 *nodes, size_t numPairs, Hash256 *digests);
+
+/*! Only use the portable implementation, even if the CPU supports a faster one.  Used to compare them in benchmarks.
+ */
+void setPortable(bool portable);
+
+/*! Name of the implementations in use, for single messages and batches.
+ */
+std::string implementation();
+
+}
+
+#endif /* BLOCKCHAIN_SHA256_H_ */
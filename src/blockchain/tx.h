@@ -9,16 +9,67 @@
 #define BLOCKCHAIN_TX_H_
 
 #include <map>
+#include <set>
 #include <iostream>
 #include <limits>
+#include <vector>
+#include <cstdint>
+#include <string>
+#include "sha256.h"
+
+/*! Number of bytes BTC uses to encode a count (its CompactSize varint).
+ */
+inline int64_t compactSizeLength(uint64_t count) {
+    return count < 0xfd ? 1 : count <= 0xffff ? 3 : count <= 0xffffffff ? 5 : 9;
+}
+
+/*! Append the low numBytes bytes of value in little endian order, as BTC's serialization does.
+ */
+inline void appendLittleEndian(std::string &out, uint64_t value, int numBytes) {
+    for (int i = 0; i < numBytes; ++i) {
+        out.push_back((char)(value >> (8 * i)));
+    }
+}
+
+inline void appendCompactSize(std::string &out, uint64_t count) {
+    int length = compactSizeLength(count);
+    if (length > 1) {
+        out.push_back((char)(length == 3 ? 0xfd : length == 5 ? 0xfe : 0xff));
+    }
+    appendLittleEndian(out, count, length == 1 ? 1 : length - 1);
+}
+
+/*! Append a 64 bit identifier as a 32 byte hash field.  Only the identifier is kept of the hashes blocks and transactions
+ * refer to, so the rest of the field is zero.
+ */
+inline void appendHashField(std::string &out, int64_t id) {
+    appendLittleEndian(out, id, 8);
+    out.append(24, '\0');
+}
+
+/*! Identifier of a block or transaction: the first 8 bytes of its double SHA-256, little endian.
+ * 0 marks a missing hash, so a digest that would give 0 is mapped to 1.
+ */
+inline int64_t identifierOf(const Hash256 &digest) {
+    uint64_t id = 0;
+    for (int i = 7; i >= 0; --i) {
+        id = id << 8 | digest[i];
+    }
+    return id == 0 ? 1 : (int64_t)id;
+}
 
 struct TransactionInput {
-    int prevTxHash; // identifier of transaction leading to this one
+    int64_t prevTxHash; // identifier of transaction leading to this one
     int prevTxN; // index of specific output within previous transaction
 
     static constexpr int COINBASE_HASH = 0;
     static constexpr int COINBASE_N = std::numeric_limits<int>::max();
 
+    // outpoint (previous tx hash and index) plus sequence number
+    static constexpr int FIXED_SERIALIZED_SIZE = 32 + 4 + 4;
+    static constexpr int SIGNATURE_SCRIPT_SIZE = 73; // push of a DER signature, as in a Pay2PK spend
+    static constexpr int COINBASE_SCRIPT_SIZE = 4; // push of the block height
+
     // if this is a coinbase then this will contain the block height
     int signature; // we are sort of implementing BTC's Pay2PK tx type
     // Pay2PK involves outputs providing a "challenge" which involves outputs asking for the
@@ -28,10 +79,17 @@ struct TransactionInput {
     /*! Coinbase transaction inputs are ones that create a new coin.
      * They are identified by the hash and n values containing special values.
      */
-    bool isCoinbase() {
+    bool isCoinbase() const {
         return prevTxHash == COINBASE_HASH && prevTxN == COINBASE_N;
     }
 
+    /*! Size of this input in BTC's wire encoding.
+     */
+    int64_t serializedSize() const {
+        int64_t scriptSize = isCoinbase() ? COINBASE_SCRIPT_SIZE : SIGNATURE_SCRIPT_SIZE;
+        return FIXED_SERIALIZED_SIZE + compactSizeLength(scriptSize) + scriptSize;
+    }
+
     friend std::ostream &operator<<(std::ostream &outputStream, const TransactionInput &txIn) {
         outputStream << txIn.prevTxHash << txIn.prevTxN << txIn.signature;
         return outputStream;
@@ -47,6 +105,9 @@ struct TransactionOutput {
     int value; // amount of "cents" of our currency
     int publicKey;
 
+    // value, script length and a Pay2PK script (push of a compressed public key and OP_CHECKSIG)
+    static constexpr int SERIALIZED_SIZE = 8 + 1 + 35;
+
     friend std::ostream &operator<<(std::ostream &outputStream, const TransactionOutput &txOut) {
         outputStream << txOut.value << txOut.publicKey;
         return outputStream;
@@ -67,6 +128,73 @@ struct Transaction {
 
     int64_t hash;
 
+    /*! Size of this transaction in BTC's (non segwit) wire encoding.
+     * Computed on each call, so callers sending the same transaction repeatedly should keep the result.
+     */
+    int64_t serializedSize() const {
+        int64_t size = 4 + compactSizeLength(inputs.size()) + compactSizeLength(outputs.size()) + 4; // version and lock time
+        for (const auto &txIn : inputs) {
+            size += txIn.serializedSize();
+        }
+        size += outputs.size() * TransactionOutput::SERIALIZED_SIZE;
+        return size;
+    }
+
+    /*! Canonical serialization the identifier is computed from.  Laid out as BTC's encoding (version, inputs, outputs,
+     * lock time), holding the fields we model: signatures and public keys take the place of the scripts.
+     */
+    std::string serialize() const {
+        std::string out;
+        appendLittleEndian(out, 1, 4); // version
+        appendCompactSize(out, inputs.size());
+        for (const auto &txIn : inputs) {
+            appendHashField(out, txIn.prevTxHash);
+            appendLittleEndian(out, (uint32_t)txIn.prevTxN, 4);
+            appendCompactSize(out, 4);
+            appendLittleEndian(out, (uint32_t)txIn.signature, 4);
+            appendLittleEndian(out, 0xffffffff, 4); // sequence
+        }
+        appendCompactSize(out, outputs.size());
+        for (const auto &txOut : outputs) {
+            appendLittleEndian(out, (uint64_t)txOut.value, 8);
+            appendCompactSize(out, 4);
+            appendLittleEndian(out, (uint32_t)txOut.publicKey, 4);
+        }
+        appendLittleEndian(out, 0, 4); // lock time
+        return out;
+    }
+
+    /*! Whether the transaction concerns one of the given public keys, as a light node's filter asks for: an output paying
+     * one of them, or an input spending with one of them (signatures are the key + 1, see POWNode::handleNewTx).
+     */
+    bool matchesFilter(const std::set<int> &publicKeys) const {
+        for (const auto &txOut : outputs) {
+            if (publicKeys.count(txOut.publicKey)) {
+                return true;
+            }
+        }
+        for (const auto &txIn : inputs) {
+            if (!txIn.isCoinbase() && publicKeys.count(txIn.signature - 1)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /*! Double SHA-256 of the serialization, the leaf of this transaction in its block's Merkle tree.
+     */
+    Hash256 computeDigest() const {
+        std::string serialized = serialize();
+        return sha256::doubleHash(serialized.data(), serialized.size());
+    }
+
+    /*! Identifier of this transaction, from the double SHA-256 of its serialization.  Transactions with the same inputs and
+     * outputs have the same identifier.
+     */
+    int64_t computeHash() const {
+        return identifierOf(computeDigest());
+    }
+
     friend std::ostream &operator<<(std::ostream &outputStream, const Transaction &tx) {
         outputStream << tx.inputs.size();
         for (auto txIn : tx.inputs) {
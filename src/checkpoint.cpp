@@ -0,0 +1,206 @@
+/*
+ * checkpoint.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "checkpoint.h"
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <sys/stat.h>
+#include <omnetpp.h>
+
+using namespace omnetpp;
+
+namespace {
+
+const char CHECKPOINT_MAGIC[] = "POWSNAP2";
+const size_t CHECKPOINT_MAGIC_SIZE = sizeof(CHECKPOINT_MAGIC) - 1;
+
+/*! A loaded checkpoint, and the modification time and size of its file when it was read.
+ *
+ */
+struct LoadedCheckpoint {
+    std::unique_ptr<Checkpoint> checkpoint;
+    time_t modified = 0;
+    off_t size = -1;
+};
+
+// kept for the whole process, so runs of a batch check that the file is unchanged before reusing an entry
+std::map<std::string, LoadedCheckpoint> loadedCheckpoints;
+
+template <typename T>
+bool readValue(std::istream &input, T &value) {
+    return static_cast<bool>(input.read(reinterpret_cast<char *>(&value), sizeof(value)));
+}
+
+template <typename T>
+void writeValue(std::ostream &output, const T &value) {
+    output.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+}
+
+void CheckpointWriter::writeString(const std::string &value) {
+    write<uint32_t>(value.size());
+    buffer.append(value);
+}
+
+void CheckpointWriter::writeTransaction(const Transaction &tx) {
+    write<int64_t>(tx.hash);
+    write<uint32_t>(tx.inputs.size());
+    for (const auto &txIn : tx.inputs) {
+        write<int64_t>(txIn.prevTxHash);
+        write<int32_t>(txIn.prevTxN);
+        write<int32_t>(txIn.signature);
+    }
+    write<uint32_t>(tx.outputs.size());
+    for (const auto &txOut : tx.outputs) {
+        write<int32_t>(txOut.value);
+        write<int32_t>(txOut.publicKey);
+    }
+}
+
+void CheckpointWriter::writeHeader(const BlockHeader &header) {
+    write<int64_t>(header.hash);
+    write<int64_t>(header.parentHash);
+    buffer.append(reinterpret_cast<const char *>(header.merkleRoot.data()), header.merkleRoot.size());
+    write<uint64_t>(header.numTx);
+    write<int32_t>(header.creationTime);
+    write<double>(header.difficulty);
+}
+
+void CheckpointWriter::writeBlock(const Block &block) {
+    // numTx in the header gives the number of transactions that follow.  they are kept in block order, so the restored
+    // block has the same Merkle root and hash
+    writeHeader(block.getHeader());
+    for (const Transaction &tx : block.getOrderedTx()) {
+        writeTransaction(tx);
+    }
+}
+
+void CheckpointReader::readBytes(char *destination, size_t size) {
+    if (data.size() - position < size) {
+        throw cRuntimeError("truncated checkpoint record");
+    }
+    std::memcpy(destination, data.data() + position, size);
+    position += size;
+}
+
+std::string CheckpointReader::readString() {
+    std::string value(read<uint32_t>(), '\0');
+    readBytes(&value[0], value.size());
+    return value;
+}
+
+Transaction CheckpointReader::readTransaction() {
+    Transaction tx;
+    tx.hash = read<int64_t>();
+    tx.inputs.resize(read<uint32_t>());
+    for (auto &txIn : tx.inputs) {
+        txIn.prevTxHash = read<int64_t>();
+        txIn.prevTxN = read<int32_t>();
+        txIn.signature = read<int32_t>();
+    }
+    tx.outputs.resize(read<uint32_t>());
+    for (auto &txOut : tx.outputs) {
+        txOut.value = read<int32_t>();
+        txOut.publicKey = read<int32_t>();
+    }
+    return tx;
+}
+
+BlockHeader CheckpointReader::readHeader() {
+    BlockHeader header;
+    header.hash = read<int64_t>();
+    header.parentHash = read<int64_t>();
+    readBytes(reinterpret_cast<char *>(header.merkleRoot.data()), header.merkleRoot.size());
+    header.numTx = read<uint64_t>();
+    header.creationTime = read<int32_t>();
+    header.difficulty = read<double>();
+    return header;
+}
+
+Block CheckpointReader::readBlock() {
+    BlockHeader header = readHeader();
+    Block block(header);
+    for (txs_size i = 0; i < header.numTx; ++i) {
+        block.addTransaction(readTransaction());
+    }
+    return block;
+}
+
+void Checkpoint::write(const std::string &fileName) const {
+    std::ofstream output(fileName, std::ios::out | std::ios::binary | std::ios::trunc);
+    output.write(CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE);
+    writeValue<double>(output, time);
+    writeValue<int32_t>(output, records.size());
+    for (const auto &record : records) {
+        writeValue<int32_t>(output, record.first);
+        writeValue<uint64_t>(output, record.second.size());
+        output.write(record.second.data(), record.second.size());
+    }
+    writeValue<int32_t>(output, churnedNodes.size());
+    for (const auto &churned : churnedNodes) {
+        writeValue<int32_t>(output, churned.first);
+        writeValue<double>(output, churned.second);
+    }
+    if (!output) {
+        throw cRuntimeError("could not write checkpoint file %s", fileName.c_str());
+    }
+    // later runs of the batch must restore the new contents, even if written within the same second
+    loadedCheckpoints.erase(fileName);
+}
+
+const Checkpoint &Checkpoint::load(const std::string &fileName) {
+    struct stat fileStat;
+    if (stat(fileName.c_str(), &fileStat) != 0) {
+        throw cRuntimeError("could not open checkpoint file %s", fileName.c_str());
+    }
+    auto &loaded = loadedCheckpoints[fileName];
+    if (loaded.checkpoint && loaded.modified == fileStat.st_mtime && loaded.size == fileStat.st_size) {
+        return *loaded.checkpoint;
+    }
+    std::ifstream input(fileName, std::ios::in | std::ios::binary);
+    if (!input) {
+        throw cRuntimeError("could not open checkpoint file %s", fileName.c_str());
+    }
+    char magic[CHECKPOINT_MAGIC_SIZE];
+    double time;
+    int32_t numRecords;
+    if (!input.read(magic, CHECKPOINT_MAGIC_SIZE) || std::memcmp(magic, CHECKPOINT_MAGIC, CHECKPOINT_MAGIC_SIZE) != 0
+            || !readValue(input, time) || !readValue(input, numRecords)) {
+        throw cRuntimeError("%s is not a checkpoint file", fileName.c_str());
+    }
+    auto result = std::make_unique<Checkpoint>(time);
+    for (int32_t i = 0; i < numRecords; ++i) {
+        int32_t index;
+        uint64_t size;
+        if (!readValue(input, index) || !readValue(input, size)) {
+            throw cRuntimeError("truncated checkpoint file %s", fileName.c_str());
+        }
+        std::string &record = result->records[index];
+        record.resize(size);
+        if (!input.read(&record[0], size)) {
+            throw cRuntimeError("truncated checkpoint file %s", fileName.c_str());
+        }
+    }
+    int32_t numChurned;
+    if (!readValue(input, numChurned)) {
+        throw cRuntimeError("truncated checkpoint file %s", fileName.c_str());
+    }
+    for (int32_t i = 0; i < numChurned; ++i) {
+        int32_t index;
+        double offlineTime;
+        if (!readValue(input, index) || !readValue(input, offlineTime)) {
+            throw cRuntimeError("truncated checkpoint file %s", fileName.c_str());
+        }
+        result->churnedNodes[index] = offlineTime;
+    }
+    loaded.checkpoint = std::move(result);
+    loaded.modified = fileStat.st_mtime;
+    loaded.size = fileStat.st_size;
+    return *loaded.checkpoint;
+}
@@ -0,0 +1,125 @@
+/*
+ * checkpoint.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef CHECKPOINT_H_
+#define CHECKPOINT_H_
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "blockchain/block.h"
+#include "blockchain/tx.h"
+
+/*! Builds the binary record of one node for a checkpoint.  Values are appended in native byte order, so a checkpoint
+ * can only be restored on the same kind of machine it was written on.
+ */
+class CheckpointWriter {
+public:
+    template <typename T>
+    void write(const T &value) {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be written directly");
+        buffer.append(reinterpret_cast<const char *>(&value), sizeof(value));
+    }
+
+    void writeString(const std::string &value);
+    void writeTransaction(const Transaction &tx);
+    void writeHeader(const BlockHeader &header);
+    void writeBlock(const Block &block);
+
+    const std::string &data() const {
+        return buffer;
+    }
+private:
+    std::string buffer;
+};
+
+/*! Reads back a record written by CheckpointWriter, in the same order.  Throws a cRuntimeError if the record is too short.
+ */
+class CheckpointReader {
+public:
+    explicit CheckpointReader(const std::string &data) : data(data), position(0) {}
+
+    template <typename T>
+    T read() {
+        static_assert(std::is_trivially_copyable<T>::value, "only plain values can be read directly");
+        T value;
+        readBytes(reinterpret_cast<char *>(&value), sizeof(value));
+        return value;
+    }
+
+    std::string readString();
+    Transaction readTransaction();
+    BlockHeader readHeader();
+    Block readBlock();
+private:
+    void readBytes(char *destination, size_t size);
+
+    const std::string &data;
+    size_t position;
+};
+
+/*! Snapshot of every node of a network at one point in simulated time.
+ * File layout: the magic bytes "POWSNAP2", the snapshot time (double, seconds), the number of records (int32), then for
+ * each node its index (int32), record length (uint64) and record.  What a record contains is up to POWNode.  The records
+ * are followed by the number of nodes taken offline by churn (int32), then for each its index (int32) and remaining
+ * offline time (double, seconds).
+ */
+class Checkpoint {
+public:
+    explicit Checkpoint(double time) : time(time) {}
+
+    void addNode(int index, const CheckpointWriter &record) {
+        records[index] = record.data();
+    }
+
+    /*! Write the checkpoint to the given file, replacing it.  Throws a cRuntimeError if the file can't be written.
+     */
+    void write(const std::string &fileName) const;
+
+    /*! Load a checkpoint file.  Every node restores from the same file, so it is read once and kept for later calls, until
+     * the file is written again or its modification time or size change (e.g. between the runs of a batch).
+     * \param fileName Path of the checkpoint file.
+     * \returns The checkpoint.  Throws a cRuntimeError if the file can't be read or is not a checkpoint.
+     */
+    static const Checkpoint &load(const std::string &fileName);
+
+    double getTime() const {
+        return time;
+    }
+
+    bool hasNode(int index) const {
+        return records.find(index) != records.end();
+    }
+
+    /*! Record a node that churn took offline, so a restored run brings it back online.
+     * \param index Index of the node.
+     * \param offlineTime Seconds until the node rejoins.
+     */
+    void addChurnedNode(int index, double offlineTime) {
+        churnedNodes[index] = offlineTime;
+    }
+
+    /*! Nodes taken offline by churn, with the seconds until they rejoin.
+     */
+    const std::map<int, double> &getChurnedNodes() const {
+        return churnedNodes;
+    }
+
+    /*! Reader for the record of the given node, which must be in the checkpoint.
+     */
+    CheckpointReader nodeRecord(int index) const {
+        return CheckpointReader(records.at(index));
+    }
+private:
+    double time; // simulation time the checkpoint was taken at
+    std::map<int, std::string> records;
+    std::map<int, double> churnedNodes; // remaining offline time of nodes taken offline by churn
+};
+
+#endif /* CHECKPOINT_H_ */
@@ -0,0 +1,89 @@
+/*
+ * handler_profiler.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "handler_profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace {
+
+// counted by the replacement operator new below while a profiler is in use.  process wide, so the allocations of
+// WorkerPool threads count towards the handler waiting for them.  a relaxed load is all profiling costs when it is disabled
+std::atomic<bool> counting(false);
+std::atomic<uint64_t> allocations(0);
+
+std::map<std::string, std::unique_ptr<HandlerProfiler>> profilers;
+std::string profileFile;
+int users = 0;
+
+}
+
+void *operator new(std::size_t size) {
+    if (counting.load(std::memory_order_relaxed)) {
+        allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (void *result = std::malloc(size ? size : 1)) {
+        return result;
+    }
+    throw std::bad_alloc();
+}
+
+void operator delete(void *ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+HandlerProfiler *HandlerProfiler::acquire(const std::string &moduleType, const std::string &outputFile) {
+    auto &profiler = profilers[moduleType];
+    if (!profiler) {
+        profiler.reset(new HandlerProfiler());
+    }
+    profileFile = outputFile;
+    if (users++ == 0) {
+        counting.store(true, std::memory_order_relaxed);
+    }
+    return profiler.get();
+}
+
+void HandlerProfiler::release() {
+    if (--users == 0) {
+        counting.store(false, std::memory_order_relaxed);
+        writeAll();
+        profilers.clear();
+    }
+}
+
+uint64_t HandlerProfiler::allocationCount() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void HandlerProfiler::writeAll() {
+    std::ofstream writer(profileFile, std::ios::out | std::ios::trunc);
+    writer << "moduleType,handler,calls,totalMs,meanUs,allocations,allocationsPerCall" << std::endl;
+    for (const auto &typeProfiler : profilers) {
+        // most expensive handlers first
+        std::vector<std::pair<std::string, HandlerStats>> handlers(typeProfiler.second->handlers.begin(), typeProfiler.second->handlers.end());
+        std::sort(handlers.begin(), handlers.end(), [](const std::pair<std::string, HandlerStats> &a, const std::pair<std::string, HandlerStats> &b) {
+            return a.second.time > b.second.time;
+        });
+        for (const auto &handler : handlers) {
+            double totalMs = std::chrono::duration<double, std::milli>(handler.second.time).count();
+            uint64_t calls = std::max<uint64_t>(handler.second.calls, 1);
+            writer << typeProfiler.first << "," << handler.first << "," << handler.second.calls << "," << totalMs << ","
+                    << totalMs * 1000 / calls << "," << handler.second.allocations << ","
+                    << (double)handler.second.allocations / calls << std::endl;
+        }
+    }
+}
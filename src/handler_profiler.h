@@ -0,0 +1,85 @@
+/*
+ * handler_profiler.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef HANDLER_PROFILER_H_
+#define HANDLER_PROFILER_H_
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+
+/*! Totals for one message handler.  Times and allocations include any handlers it calls, and allocations include those
+ * made on other threads while it runs, e.g. by the WorkerPool validating its blocks.
+ */
+struct HandlerStats {
+    uint64_t calls = 0;
+    std::chrono::steady_clock::duration time = std::chrono::steady_clock::duration::zero();
+    uint64_t allocations = 0;
+};
+
+/*! Per handler call counts, wall time and heap allocations, shared by all modules of one type.
+ * Modules get a profiler with acquire and must release it in finish.  When the last module releases its profiler, the
+ * totals of every module type are written to a CSV file.
+ */
+class HandlerProfiler {
+public:
+    /*! Get the profiler for a module type, creating it if needed.
+     * \param moduleType Type of the calling module, e.g. its NED type name.
+     * \param outputFile File the totals are written to.  The last file given by any module is used.
+     */
+    static HandlerProfiler *acquire(const std::string &moduleType, const std::string &outputFile);
+
+    /*! Stop using the profiler.  Writes the totals once all profilers have been released.
+     */
+    void release();
+
+    HandlerStats &stats(const char *handler) {
+        return handlers[handler];
+    }
+
+    /*! Number of heap allocations made by all threads while a profiler was in use.
+     */
+    static uint64_t allocationCount();
+
+private:
+    static void writeAll();
+
+    std::map<std::string, HandlerStats> handlers;
+};
+
+/*! Adds the time and allocations between its construction and destruction to a handler's totals.
+ * Does nothing if the profiler is null, so it can be left in place when profiling is disabled.
+ */
+class ProfileScope {
+public:
+    ProfileScope(HandlerProfiler *profiler, const char *handler) : stats(nullptr) {
+        if (profiler) {
+            stats = &profiler->stats(handler);
+            allocations = HandlerProfiler::allocationCount();
+            start = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (stats) {
+            stats->time += std::chrono::steady_clock::now() - start;
+            stats->allocations += HandlerProfiler::allocationCount() - allocations;
+            stats->calls++;
+        }
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    HandlerStats *stats;
+    uint64_t allocations;
+    std::chrono::steady_clock::time_point start;
+};
+
+#endif /* HANDLER_PROFILER_H_ */
@@ -27,7 +27,7 @@
 /**
  * Class generated from <tt>messages/addrs_message.msg:25</tt> by nedtool.
  * <pre>
- * message AddrsMessage extends POWMessage
+ * packet AddrsMessage extends POWMessage
  * {
  *     AddressesVector addresses;
  * }
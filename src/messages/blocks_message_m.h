@@ -21,6 +21,7 @@
 // cplusplus {{
     #include "../blockchain/block.h"
     #include "pow_message_m.h"
+    #include "payload_packing.h"
     #include <vector>
     #include <memory>
     typedef std::vector<Block> blocksVector;
@@ -29,7 +30,7 @@
 /**
  * Class generated from <tt>messages/blocks_message.msg:28</tt> by nedtool.
  * <pre>
- * message BlocksMessage extends POWMessage
+ * packet BlocksMessage extends POWMessage
  * {
  *     blocksVector blocks;
  * }
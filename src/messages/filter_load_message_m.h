@@ -0,0 +1,69 @@
+//
+// Hand-maintained, in the layout nedtool 5.4 generates for messages/filter_load_message.msg.
+// Keep it in step with the .msg file: running opp_msgc on it replaces this file.
+//
+
+#if defined(__clang__)
+#  pragma clang diagnostic ignored "-Wreserved-id-macro"
+#endif
+#ifndef __FILTER_LOAD_MESSAGE_M_H
+#define __FILTER_LOAD_MESSAGE_M_H
+
+#include <omnetpp.h>
+
+// nedtool version check
+#define MSGC_VERSION 0x0504
+#if (MSGC_VERSION!=OMNETPP_VERSION)
+#    error Version mismatch! Probably this file was generated by an earlier version of nedtool: 'make clean' should help.
+#endif
+
+
+
+// cplusplus {{
+    #include "pow_message_m.h"
+    #include <vector>
+    typedef std::vector<int> PublicKeysVector;
+// }}
+
+/**
+ * Class generated from <tt>messages/filter_load_message.msg:25</tt> by nedtool.
+ * <pre>
+ * packet FilterLoadMessage extends POWMessage
+ * {
+ *     PublicKeysVector publicKeys;
+ * }
+ * </pre>
+ */
+class FilterLoadMessage : public ::POWMessage
+{
+  protected:
+    PublicKeysVector publicKeys;
+
+  private:
+    void copy(const FilterLoadMessage& other);
+
+  protected:
+    // protected and unimplemented operator==(), to prevent accidental usage
+    bool operator==(const FilterLoadMessage&);
+
+  public:
+    FilterLoadMessage(const char *name=nullptr, short kind=0);
+    FilterLoadMessage(const FilterLoadMessage& other);
+    virtual ~FilterLoadMessage();
+    FilterLoadMessage& operator=(const FilterLoadMessage& other);
+    virtual FilterLoadMessage *dup() const override {return new FilterLoadMessage(*this);}
+    virtual void parsimPack(omnetpp::cCommBuffer *b) const override;
+    virtual void parsimUnpack(omnetpp::cCommBuffer *b) override;
+
+    // field getter/setter methods
+    virtual PublicKeysVector& getPublicKeys();
+    virtual const PublicKeysVector& getPublicKeys() const {return const_cast<FilterLoadMessage*>(this)->getPublicKeys();}
+    virtual void setPublicKeys(const PublicKeysVector& publicKeys);
+};
+
+inline void doParsimPacking(omnetpp::cCommBuffer *b, const FilterLoadMessage& obj) {obj.parsimPack(b);}
+inline void doParsimUnpacking(omnetpp::cCommBuffer *b, FilterLoadMessage& obj) {obj.parsimUnpack(b);}
+
+
+#endif // ifndef __FILTER_LOAD_MESSAGE_M_H
+
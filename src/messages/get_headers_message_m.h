@@ -25,7 +25,7 @@
 /**
  * Class generated from <tt>messages/get_headers_message.msg:22</tt> by nedtool.
  * <pre>
- * message GetHeadersMessage extends POWMessage
+ * packet GetHeadersMessage extends POWMessage
  * {
  *     int64_t hash;
  * }
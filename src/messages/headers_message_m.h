@@ -21,6 +21,7 @@
 // cplusplus {{
     #include "../blockchain/block.h"
     #include "pow_message_m.h"
+    #include "payload_packing.h"
     #include <vector>
     typedef std::vector<BlockHeader> HeadersVector;
 // }}
@@ -28,7 +29,7 @@
 /**
  * Class generated from <tt>messages/headers_message.msg:27</tt> by nedtool.
  * <pre>
- * message HeadersMessage extends POWMessage
+ * packet HeadersMessage extends POWMessage
  * {
  *     HeadersVector headers;
  * }
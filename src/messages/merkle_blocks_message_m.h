@@ -0,0 +1,72 @@
+//
+// Hand-maintained, in the layout nedtool 5.4 generates for messages/merkle_blocks_message.msg.
+// Keep it in step with the .msg file: running opp_msgc on it replaces this file.
+//
+
+#if defined(__clang__)
+#  pragma clang diagnostic ignored "-Wreserved-id-macro"
+#endif
+#ifndef __MERKLE_BLOCKS_MESSAGE_M_H
+#define __MERKLE_BLOCKS_MESSAGE_M_H
+
+#include <omnetpp.h>
+
+// nedtool version check
+#define MSGC_VERSION 0x0504
+#if (MSGC_VERSION!=OMNETPP_VERSION)
+#    error Version mismatch! Probably this file was generated by an earlier version of nedtool: 'make clean' should help.
+#endif
+
+
+
+// cplusplus {{
+    #include "../blockchain/block.h"
+    #include "pow_message_m.h"
+    #include "payload_packing.h"
+    #include <vector>
+    #include <memory>
+    typedef std::vector<MerkleBlock> MerkleBlocksVector;
+// }}
+
+/**
+ * Class generated from <tt>messages/merkle_blocks_message.msg:28</tt> by nedtool.
+ * <pre>
+ * packet MerkleBlocksMessage extends POWMessage
+ * {
+ *     MerkleBlocksVector merkleBlocks;
+ * }
+ * </pre>
+ */
+class MerkleBlocksMessage : public ::POWMessage
+{
+  protected:
+    MerkleBlocksVector merkleBlocks;
+
+  private:
+    void copy(const MerkleBlocksMessage& other);
+
+  protected:
+    // protected and unimplemented operator==(), to prevent accidental usage
+    bool operator==(const MerkleBlocksMessage&);
+
+  public:
+    MerkleBlocksMessage(const char *name=nullptr, short kind=0);
+    MerkleBlocksMessage(const MerkleBlocksMessage& other);
+    virtual ~MerkleBlocksMessage();
+    MerkleBlocksMessage& operator=(const MerkleBlocksMessage& other);
+    virtual MerkleBlocksMessage *dup() const override {return new MerkleBlocksMessage(*this);}
+    virtual void parsimPack(omnetpp::cCommBuffer *b) const override;
+    virtual void parsimUnpack(omnetpp::cCommBuffer *b) override;
+
+    // field getter/setter methods
+    virtual MerkleBlocksVector& getMerkleBlocks();
+    virtual const MerkleBlocksVector& getMerkleBlocks() const {return const_cast<MerkleBlocksMessage*>(this)->getMerkleBlocks();}
+    virtual void setMerkleBlocks(const MerkleBlocksVector& merkleBlocks);
+};
+
+inline void doParsimPacking(omnetpp::cCommBuffer *b, const MerkleBlocksMessage& obj) {obj.parsimPack(b);}
+inline void doParsimUnpacking(omnetpp::cCommBuffer *b, MerkleBlocksMessage& obj) {obj.parsimUnpack(b);}
+
+
+#endif // ifndef __MERKLE_BLOCKS_MESSAGE_M_H
+
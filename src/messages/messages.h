@@ -17,5 +17,7 @@
 #include "scheduler_message_m.h"
 #include "tx_message_m.h"
 #include "blocks_message_m.h"
+#include "filter_load_message_m.h"
+#include "merkle_blocks_message_m.h"
 
 #endif /* MESSAGES_MESSAGES_H_ */
@@ -0,0 +1,149 @@
+/*
+ * payload_packing.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef MESSAGES_PAYLOAD_PACKING_H_
+#define MESSAGES_PAYLOAD_PACKING_H_
+
+#include <omnetpp.h>
+#include "../blockchain/block.h"
+#include "../blockchain/tx.h"
+
+/* Parallel simulation packing for the blockchain types carried by POWMessages.
+ * The generated message code finds these through ordinary lookup (for message fields) and argument dependent lookup
+ * (for elements of vectors of these types), so they live in the global namespace next to the types themselves.
+ */
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const TransactionInput &txIn) {
+    buffer->pack(txIn.prevTxHash);
+    buffer->pack(txIn.prevTxN);
+    buffer->pack(txIn.signature);
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, TransactionInput &txIn) {
+    buffer->unpack(txIn.prevTxHash);
+    buffer->unpack(txIn.prevTxN);
+    buffer->unpack(txIn.signature);
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const TransactionOutput &txOut) {
+    buffer->pack(txOut.value);
+    buffer->pack(txOut.publicKey);
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, TransactionOutput &txOut) {
+    buffer->unpack(txOut.value);
+    buffer->unpack(txOut.publicKey);
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const Transaction &tx) {
+    buffer->pack(tx.hash);
+    buffer->pack((int)tx.inputs.size());
+    for (const auto &txIn : tx.inputs) {
+        doParsimPacking(buffer, txIn);
+    }
+    buffer->pack((int)tx.outputs.size());
+    for (const auto &txOut : tx.outputs) {
+        doParsimPacking(buffer, txOut);
+    }
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, Transaction &tx) {
+    buffer->unpack(tx.hash);
+    int count;
+    buffer->unpack(count);
+    tx.inputs.resize(count);
+    for (auto &txIn : tx.inputs) {
+        doParsimUnpacking(buffer, txIn);
+    }
+    buffer->unpack(count);
+    tx.outputs.resize(count);
+    for (auto &txOut : tx.outputs) {
+        doParsimUnpacking(buffer, txOut);
+    }
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const BlockHeader &header) {
+    buffer->pack(header.hash);
+    buffer->pack(header.parentHash);
+    buffer->pack(header.merkleRoot.data(), header.merkleRoot.size());
+    buffer->pack(header.numTx);
+    buffer->pack(header.creationTime);
+    buffer->pack(header.difficulty);
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, BlockHeader &header) {
+    buffer->unpack(header.hash);
+    buffer->unpack(header.parentHash);
+    buffer->unpack(header.merkleRoot.data(), header.merkleRoot.size());
+    buffer->unpack(header.numTx);
+    buffer->unpack(header.creationTime);
+    buffer->unpack(header.difficulty);
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const Block &block) {
+    doParsimPacking(buffer, block.getHeader());
+    // the header already holds the number of transactions.  they are sent in block order, as the Merkle root depends on it
+    for (int64_t txHash : block.txOrder) {
+        doParsimPacking(buffer, block.transactions.at(txHash));
+    }
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, Block &block) {
+    doParsimUnpacking(buffer, block.header);
+    block.transactions.clear();
+    block.txOrder.clear();
+    block.idsStale = false;
+    block.merkleTree = MerkleTree();
+    block.serializedSizeCache = -1;
+    for (txs_size i = 0; i < block.header.numTx; ++i) {
+        Transaction tx;
+        doParsimUnpacking(buffer, tx);
+        block.txOrder.push_back(tx.hash);
+        block.transactions.insert(std::make_pair(tx.hash, std::move(tx)));
+    }
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const MerkleProof &proof) {
+    buffer->pack(proof.index);
+    buffer->pack((int)proof.siblings.size());
+    for (const Hash256 &sibling : proof.siblings) {
+        buffer->pack(sibling.data(), sibling.size());
+    }
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, MerkleProof &proof) {
+    buffer->unpack(proof.index);
+    int count;
+    buffer->unpack(count);
+    proof.siblings.resize(count);
+    for (Hash256 &sibling : proof.siblings) {
+        buffer->unpack(sibling.data(), sibling.size());
+    }
+}
+
+inline void doParsimPacking(omnetpp::cCommBuffer *buffer, const MerkleBlock &merkleBlock) {
+    doParsimPacking(buffer, merkleBlock.header);
+    buffer->pack((int)merkleBlock.transactions.size());
+    for (txs_size i = 0; i < merkleBlock.transactions.size(); ++i) {
+        doParsimPacking(buffer, merkleBlock.transactions[i]);
+        doParsimPacking(buffer, merkleBlock.proofs[i]);
+    }
+}
+
+inline void doParsimUnpacking(omnetpp::cCommBuffer *buffer, MerkleBlock &merkleBlock) {
+    doParsimUnpacking(buffer, merkleBlock.header);
+    int count;
+    buffer->unpack(count);
+    merkleBlock.transactions.resize(count);
+    merkleBlock.proofs.resize(count);
+    for (int i = 0; i < count; ++i) {
+        doParsimUnpacking(buffer, merkleBlock.transactions[i]);
+        doParsimUnpacking(buffer, merkleBlock.proofs[i]);
+    }
+}
+
+#endif /* MESSAGES_PAYLOAD_PACKING_H_ */
@@ -179,13 +179,13 @@ inline std::ostream& operator<<(std::ostream& out, const std::vector<T,A>& vec)
 
 Register_Class(POWMessage)
 
-POWMessage::POWMessage(const char *name, short kind) : ::omnetpp::cMessage(name,kind)
+POWMessage::POWMessage(const char *name, short kind) : ::omnetpp::cPacket(name,kind)
 {
     this->source = 0;
     this->versionNo = 0;
 }
 
-POWMessage::POWMessage(const POWMessage& other) : ::omnetpp::cMessage(other)
+POWMessage::POWMessage(const POWMessage& other) : ::omnetpp::cPacket(other)
 {
     copy(other);
 }
@@ -197,7 +197,7 @@ POWMessage::~POWMessage()
 POWMessage& POWMessage::operator=(const POWMessage& other)
 {
     if (this==&other) return *this;
-    ::omnetpp::cMessage::operator=(other);
+    ::omnetpp::cPacket::operator=(other);
     copy(other);
     return *this;
 }
@@ -211,7 +211,7 @@ void POWMessage::copy(const POWMessage& other)
 
 void POWMessage::parsimPack(omnetpp::cCommBuffer *b) const
 {
-    ::omnetpp::cMessage::parsimPack(b);
+    ::omnetpp::cPacket::parsimPack(b);
     doParsimPacking(b,this->command);
     doParsimPacking(b,this->source);
     doParsimPacking(b,this->versionNo);
@@ -219,7 +219,7 @@ void POWMessage::parsimPack(omnetpp::cCommBuffer *b) const
 
 void POWMessage::parsimUnpack(omnetpp::cCommBuffer *b)
 {
-    ::omnetpp::cMessage::parsimUnpack(b);
+    ::omnetpp::cPacket::parsimUnpack(b);
     doParsimUnpacking(b,this->command);
     doParsimUnpacking(b,this->source);
     doParsimUnpacking(b,this->versionNo);
@@ -285,7 +285,7 @@ class POWMessageDescriptor : public omnetpp::cClassDescriptor
 
 Register_ClassDescriptor(POWMessageDescriptor)
 
-POWMessageDescriptor::POWMessageDescriptor() : omnetpp::cClassDescriptor("POWMessage", "omnetpp::cMessage")
+POWMessageDescriptor::POWMessageDescriptor() : omnetpp::cClassDescriptor("POWMessage", "omnetpp::cPacket")
 {
     propertynames = nullptr;
 }
@@ -21,7 +21,7 @@
 /**
  * Class generated from <tt>messages/pow_message.msg:16</tt> by nedtool.
  * <pre>
- * message POWMessage
+ * packet POWMessage
  * {
  *     string command; // name of command to execute upon reaching destination 
  *     int source; // source node index of the sending node
@@ -29,7 +29,7 @@
  * }
  * </pre>
  */
-class POWMessage : public ::omnetpp::cMessage
+class POWMessage : public ::omnetpp::cPacket
 {
   protected:
     ::omnetpp::opp_string command;
@@ -25,7 +25,7 @@
 /**
  * Class generated from <tt>messages/reject_message.msg:22</tt> by nedtool.
  * <pre>
- * message RejectMessage extends POWMessage
+ * packet RejectMessage extends POWMessage
  * {
  *     bool disconnect;
  *     string reason;
@@ -21,12 +21,13 @@
 // cplusplus {{
     #include "../blockchain/tx.h"
     #include "pow_message_m.h"
+    #include "payload_packing.h"
 // }}
 
 /**
  * Class generated from <tt>messages/tx_message.msg:24</tt> by nedtool.
  * <pre>
- * message TxMessage extends POWMessage
+ * packet TxMessage extends POWMessage
  * {
  *     Transaction tx;
  * }
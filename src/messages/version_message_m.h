@@ -25,7 +25,7 @@
 /**
  * Class generated from <tt>messages/version_message.msg:22</tt> by nedtool.
  * <pre>
- * message VersionMessage extends POWMessage
+ * packet VersionMessage extends POWMessage
  * {
  *     int chainHeight;
  * }
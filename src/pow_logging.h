@@ -0,0 +1,46 @@
+/*
+ * pow_logging.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef POW_LOGGING_H_
+#define POW_LOGGING_H_
+
+#include <omnetpp.h>
+#include <string>
+
+/* Logging for the hot paths of the simulation modules.
+ *
+ * POW_EV, POW_EV_DETAIL, etc. are used like EV, but the whole statement is skipped unless its level is at or above
+ * POW_COMPILETIME_LOGLEVEL and logging is enabled at run time (it is not in Cmdenv express mode).  The streamed arguments
+ * are never evaluated when a statement is skipped, and statements below the compile time level are removed by the compiler.
+ * Set the level with make LOGLEVEL=WARN (see the Makefile).
+ */
+
+#ifndef POW_COMPILETIME_LOGLEVEL
+#define POW_COMPILETIME_LOGLEVEL COMPILETIME_LOGLEVEL
+#endif
+
+#define POW_LOG(level) \
+    if (!((level) >= POW_COMPILETIME_LOGLEVEL && omnetpp::getEnvir()->isLoggingEnabled())) ; else EV_LOG(level, nullptr)
+
+#define POW_EV_TRACE POW_LOG(omnetpp::LOGLEVEL_TRACE)
+#define POW_EV_DEBUG POW_LOG(omnetpp::LOGLEVEL_DEBUG)
+#define POW_EV_DETAIL POW_LOG(omnetpp::LOGLEVEL_DETAIL)
+#define POW_EV POW_LOG(omnetpp::LOGLEVEL_INFO)
+#define POW_EV_WARN POW_LOG(omnetpp::LOGLEVEL_WARN)
+#define POW_EV_ERROR POW_LOG(omnetpp::LOGLEVEL_ERROR)
+
+/* Shows a bubble over the module, only when it can be seen: in a GUI that is not running in express mode.
+ * The text is not evaluated otherwise, so it can be built by string concatenation.
+ */
+#define POW_BUBBLE(text) \
+    do { \
+        if (omnetpp::getEnvir()->isGUI() && !omnetpp::getEnvir()->isExpressMode()) { \
+            bubble(std::string(text).c_str()); \
+        } \
+    } while (0)
+
+#endif /* POW_LOGGING_H_ */
@@ -24,10 +24,21 @@ enum POWNodeFlags {
     Disconnect,
     PauseSend,
     PauseReceive,
-    RequestHeaders,
+    FilterLoaded, // the peer is a light node, which only takes filtered blocks and can't serve blocks
     NumFlags,
 };
 
+/*! Where block sync with a peer is.  Sync moves on as the peer's replies arrive, and is given up if a reply takes longer
+ * than the syncTimeout parameter.
+ */
+enum SyncState {
+    SyncIdle, // nothing requested from the peer
+    SyncHeadersRequested, // waiting for the headers after our tip
+    SyncBlocksInFlight, // waiting for the blocks (filtered blocks for a light node) of new headers
+    SyncBackoff, // the peer stalled and there was no other peer to sync from.  it is asked again at syncDeadline
+    SyncSynced, // the peer's last reply brought us up to its chain
+};
+
 /*! Structure representing data a node knows about a peer.
  */
 struct POWNodeData {
@@ -48,7 +59,28 @@ struct POWNodeData {
     // blocks to be sent to this peer in the sendOutgoingData phase
     std::vector<Block> blocksToSend;
 
+    // blocks to be sent filtered to a light peer in the sendOutgoingData phase
+    std::vector<Block> merkleBlocksToSend;
+
+    // public keys a light peer wants the transactions of, see FilterLoaded
+    std::set<int> filter;
+
     int64_t pubHash;
+
+    // time the connection was established, used when choosing an inbound peer to evict
+    omnetpp::simtime_t connectedTime;
+
+    SyncState syncState = SyncIdle;
+
+    // when the pending headers or blocks request is given up, while syncState is SyncHeadersRequested or SyncBlocksInFlight,
+    // or when the peer is asked again, while syncState is SyncBackoff
+    omnetpp::simtime_t syncDeadline;
+
+    // sync requests retried since the peer last answered one
+    int syncRetries = 0;
+
+    // number of blocks before our tip the last getheaders started at.  doubled while the peer's headers don't connect to our chain
+    long locatorDepth = 1;
 };
 
 #endif /* POW_NODE_DATA_H_ */
@@ -0,0 +1,111 @@
+/*
+ * schedule_reader.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "schedule_reader.h"
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <omnetpp.h>
+#include "POWScheduler.h"
+
+using namespace omnetpp;
+
+namespace {
+
+const char BINARY_MAGIC[] = "POWSCHED";
+const size_t BINARY_MAGIC_SIZE = sizeof(BINARY_MAGIC) - 1;
+
+// binary records store the event type as an index into this table
+const char *const BINARY_EVENT_TYPES[] = {
+        POWScheduler::SCHEDULER_MESSAGE_NEW_BLOCK,
+        POWScheduler::SCHEDULER_MESSAGE_TX,
+        POWScheduler::SCHEDULER_MESSAGE_NODE_LEAVE,
+        POWScheduler::SCHEDULER_MESSAGE_NODE_JOIN,
+};
+const size_t NUM_BINARY_EVENT_TYPES = sizeof(BINARY_EVENT_TYPES) / sizeof(BINARY_EVENT_TYPES[0]);
+
+class TextScheduleReader : public ScheduleReader {
+public:
+    explicit TextScheduleReader(std::ifstream &&input) : input(std::move(input)) {}
+
+    virtual bool next(ScheduleEvent &event) override {
+        for (std::string line; std::getline(input, line);) {
+            if (line.find_first_not_of(" \t\r") == std::string::npos) {
+                continue;
+            }
+            // schedule syntax: timeToSend nodeAddress messageType messageParams
+            // messageParams is value,value,value
+            // each schedule message has its expected order and number of parameters
+            cStringTokenizer tok(line.c_str(), " ");
+            event.time = std::stoi(tok.nextToken());
+            event.address = std::stoi(tok.nextToken());
+            event.type = tok.nextToken();
+            event.parameters.clear();
+            if (tok.hasMoreTokens()) {
+                event.parameters = cStringTokenizer(tok.nextToken(), ",").asIntVector();
+            }
+            return true;
+        }
+        return false;
+    }
+private:
+    std::ifstream input;
+};
+
+/* Binary record layout (native byte order):
+ * int32 time, int32 address, uint8 type index, uint8 number of parameters, int32 parameters[number of parameters]
+ */
+class BinaryScheduleReader : public ScheduleReader {
+public:
+    explicit BinaryScheduleReader(std::ifstream &&input) : input(std::move(input)) {}
+
+    virtual bool next(ScheduleEvent &event) override {
+        int32_t time, address;
+        uint8_t type, numParameters;
+        if (!read(time) || !read(address) || !read(type) || !read(numParameters)) {
+            return false;
+        }
+        if (type >= NUM_BINARY_EVENT_TYPES) {
+            throw cRuntimeError("unknown event type %d in binary schedule", type);
+        }
+        event.time = time;
+        event.address = address;
+        event.type = BINARY_EVENT_TYPES[type];
+        event.parameters.resize(numParameters);
+        for (uint8_t i = 0; i < numParameters; ++i) {
+            int32_t parameter;
+            if (!read(parameter)) {
+                throw cRuntimeError("truncated binary schedule");
+            }
+            event.parameters[i] = parameter;
+        }
+        return true;
+    }
+private:
+    template <typename T>
+    bool read(T &value) {
+        return static_cast<bool>(input.read(reinterpret_cast<char *>(&value), sizeof(value)));
+    }
+
+    std::ifstream input;
+};
+
+}
+
+std::unique_ptr<ScheduleReader> ScheduleReader::open(const std::string &fileName) {
+    std::ifstream input(fileName, std::ios::in | std::ios::binary);
+    if (!input) {
+        return nullptr;
+    }
+    char magic[BINARY_MAGIC_SIZE];
+    if (input.read(magic, BINARY_MAGIC_SIZE) && std::memcmp(magic, BINARY_MAGIC, BINARY_MAGIC_SIZE) == 0) {
+        return std::make_unique<BinaryScheduleReader>(std::move(input));
+    }
+    input.clear();
+    input.seekg(0);
+    return std::make_unique<TextScheduleReader>(std::move(input));
+}
@@ -0,0 +1,47 @@
+/*
+ * schedule_reader.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef SCHEDULE_READER_H_
+#define SCHEDULE_READER_H_
+
+#include <memory>
+#include <string>
+#include <vector>
+
+/*! A single line of a simulation schedule.
+ */
+struct ScheduleEvent {
+    int time; // seconds after the start of the schedule
+    int address; // index of the node the event is sent to
+    std::string type; // scheduler message name
+    std::vector<int> parameters;
+};
+
+/*! Reads the events of a schedule file one at a time, so the whole schedule never has to be held in memory.
+ * Two formats are supported:
+ * - text: one event per line, "time address type param,param,..."
+ * - binary: the magic bytes "POWSCHED" followed by one record per event (see schedule_reader.cpp).  Produced by tools/schedule_to_binary.py.
+ * Events are expected to be in nondecreasing order of time.
+ */
+class ScheduleReader {
+public:
+    virtual ~ScheduleReader() {}
+
+    /*! Open the given schedule file, detecting its format from its first bytes.
+     * \param fileName Path of the schedule file.
+     * \returns Reader for the file, or nullptr if it could not be opened.
+     */
+    static std::unique_ptr<ScheduleReader> open(const std::string &fileName);
+
+    /*! Read the next event.
+     * \param event Filled in with the next event.
+     * \returns False once the end of the schedule has been reached.
+     */
+    virtual bool next(ScheduleEvent &event) = 0;
+};
+
+#endif /* SCHEDULE_READER_H_ */
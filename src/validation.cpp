@@ -0,0 +1,87 @@
+/*
+ * validation.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "validation.h"
+#include <algorithm>
+#include <map>
+#include <string>
+#include "blockchain/merkle.h"
+#include "blockchain/sha256.h"
+
+namespace {
+
+// fewer transactions than this per thread aren't worth waking the workers for
+const size_t TX_GRAIN = 32;
+
+bool spendsTip(const Transaction &tx, const std::map<int64_t, Transaction> &tipTx) {
+    if (tx.computeHash() != tx.hash) {
+        return false;
+    }
+    // TODO: for now don't check for double spends
+    return std::all_of(tx.inputs.begin(), tx.inputs.end(), [&](const TransactionInput &in) {
+        auto prevIt = tipTx.find(in.prevTxHash);
+        return prevIt != tipTx.end() && in.prevTxN >= 0 && in.prevTxN < (int)prevIt->second.outputs.size() &&
+                prevIt->second.outputs[in.prevTxN].publicKey == in.signature - 1;
+    });
+}
+
+/*! Run task on the pool, or on the calling thread if there is none.
+ *
+ */
+void run(WorkerPool *pool, size_t count, const std::function<void(size_t, size_t)> &task) {
+    if (pool) {
+        pool->parallelFor(count, TX_GRAIN, task);
+    } else if (count > 0) {
+        task(0, count);
+    }
+}
+
+}
+
+namespace validation {
+
+bool checkBlock(const Block &block, WorkerPool *pool) {
+    BlockHeader header = block.getHeader();
+    std::vector<Transaction> transactions = block.getOrderedTx();
+    if (transactions.size() != header.numTx) {
+        return false;
+    }
+    std::vector<Hash256> leaves(transactions.size());
+    // char rather than bool, so each range writes to its own bytes
+    std::vector<char> idsMatch(transactions.size());
+    run(pool, transactions.size(), [&](size_t begin, size_t end) {
+        std::vector<std::string> serialized;
+        serialized.reserve(end - begin);
+        for (size_t i = begin; i < end; ++i) {
+            serialized.push_back(transactions[i].serialize());
+        }
+        sha256::doubleHashMany(serialized, &leaves[begin]);
+        for (size_t i = begin; i < end; ++i) {
+            idsMatch[i] = identifierOf(leaves[i]) == transactions[i].hash;
+        }
+    });
+    if (std::find(idsMatch.begin(), idsMatch.end(), 0) != idsMatch.end()) {
+        return false;
+    }
+    // the tree only hashes about as many pairs as there are transactions, so it is built on this thread
+    MerkleTree tree;
+    tree.append(leaves.data(), leaves.size());
+    return tree.root() == header.merkleRoot;
+}
+
+std::vector<bool> checkTransactions(const std::vector<Transaction> &transactions, const Block &tip, WorkerPool *pool) {
+    std::map<int64_t, Transaction> tipTx = tip.getTx();
+    std::vector<char> valid(transactions.size());
+    run(pool, transactions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            valid[i] = spendsTip(transactions[i], tipTx);
+        }
+    });
+    return std::vector<bool>(valid.begin(), valid.end());
+}
+
+}
@@ -0,0 +1,39 @@
+/*
+ * validation.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef VALIDATION_H_
+#define VALIDATION_H_
+
+#include <vector>
+#include "blockchain/block.h"
+#include "blockchain/tx.h"
+#include "worker_pool.h"
+
+/* Checks of received blocks and mempool transactions.  The transactions are checked in parallel on a WorkerPool, and the
+ * results are put together in transaction order, so they are the same as checking them one by one.
+ */
+namespace validation {
+
+/*! Whether the transactions of a block match its header: the identifier of each transaction is the hash of its contents,
+ * and the Merkle root of the transactions is the one in the header.
+ * \param block Block to check.
+ * \param pool Pool the transactions are hashed on, or nullptr to hash them on the calling thread.
+ */
+bool checkBlock(const Block &block, WorkerPool *pool);
+
+/*! Check transactions spending outputs of the tip block: the identifier of each transaction is the hash of its contents,
+ * and each input spends an output of the tip paying the key it signs for.
+ * \param transactions Transactions to check.
+ * \param tip Block whose outputs the transactions spend.
+ * \param pool Pool the transactions are checked on, or nullptr to check them on the calling thread.
+ * \returns Whether each transaction is valid, in the order of transactions.
+ */
+std::vector<bool> checkTransactions(const std::vector<Transaction> &transactions, const Block &tip, WorkerPool *pool);
+
+}
+
+#endif /* VALIDATION_H_ */
@@ -0,0 +1,102 @@
+/*
+ * worker_pool.cpp
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#include "worker_pool.h"
+#include <algorithm>
+
+namespace {
+
+WorkerPool *pool = nullptr;
+int users = 0;
+
+}
+
+WorkerPool *WorkerPool::acquire(unsigned threads) {
+    if (!pool) {
+        if (threads == 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pool = new WorkerPool(threads);
+    }
+    ++users;
+    return pool;
+}
+
+void WorkerPool::release() {
+    if (--users == 0) {
+        delete pool;
+        pool = nullptr;
+    }
+}
+
+WorkerPool::WorkerPool(unsigned threads) {
+    for (unsigned i = 1; i < threads; ++i) {
+        workers.emplace_back(&WorkerPool::workerLoop, this);
+    }
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+        worker.join();
+    }
+}
+
+void WorkerPool::parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &task) {
+    size_t ranges = std::min<size_t>(size(), count / std::max<size_t>(grain, 1));
+    if (ranges < 2) {
+        // not worth waking the workers
+        if (count > 0) {
+            task(0, count);
+        }
+        return;
+    }
+    std::unique_lock<std::mutex> lock(mutex);
+    this->task = &task;
+    this->count = count;
+    numRanges = ranges;
+    nextRange = 0;
+    rangesLeft = ranges;
+    ++generation;
+    wake.notify_all();
+    runRanges(lock);
+    done.wait(lock, [this] { return rangesLeft == 0; });
+    this->task = nullptr;
+}
+
+void WorkerPool::workerLoop() {
+    std::unique_lock<std::mutex> lock(mutex);
+    uint64_t seen = 0;
+    while (true) {
+        wake.wait(lock, [&, this] { return stopping || generation != seen; });
+        if (stopping) {
+            return;
+        }
+        seen = generation;
+        runRanges(lock);
+    }
+}
+
+void WorkerPool::runRanges(std::unique_lock<std::mutex> &lock) {
+    while (nextRange < numRanges) {
+        size_t range = nextRange++;
+        // ranges differ by at most one item
+        size_t begin = range * count / numRanges;
+        size_t end = (range + 1) * count / numRanges;
+        const auto *current = task;
+        lock.unlock();
+        (*current)(begin, end);
+        lock.lock();
+        if (--rangesLeft == 0) {
+            done.notify_all();
+        }
+    }
+}
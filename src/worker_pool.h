@@ -0,0 +1,77 @@
+/*
+ * worker_pool.h
+ *
+ *  Created on: Oct 18, 2026
+ *      Author: jburke
+ */
+
+#ifndef WORKER_POOL_H_
+#define WORKER_POOL_H_
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*! Threads shared by all modules of the process, used to split the work of a single event (e.g. validating the
+ * transactions of a block) over the idle cores.  parallelFor only returns once all of the work is done, so events still
+ * run one after the other as the simulation kernel expects.
+ * Modules get the pool with acquire and must release it in finish.  The threads are stopped when the last module releases it.
+ */
+class WorkerPool {
+public:
+    /*! Get the pool, starting it if needed.
+     * \param threads Number of threads work is split over, including the calling thread.  0 for one per core.  Only the
+     * value given by the first module is used.
+     */
+    static WorkerPool *acquire(unsigned threads);
+
+    /*! Stop using the pool.  The threads are stopped once all modules have released it.
+     */
+    void release();
+
+    /*! Number of threads work is split over, including the calling thread.
+     *
+     */
+    unsigned size() const {
+        return workers.size() + 1;
+    }
+
+    /*! Call task on contiguous ranges covering [0, count), spread over the workers and the calling thread, and wait for
+     * all of them.  Tasks run concurrently, so each must only write to the results of its own range, and must not throw.
+     * Only one thread may call parallelFor at a time.
+     * \param count Number of items.
+     * \param grain Minimum number of items per range.  Fewer items than twice this are run on the calling thread alone.
+     * \param task Called with the begin and end of each range.
+     */
+    void parallelFor(size_t count, size_t grain, const std::function<void(size_t, size_t)> &task);
+
+private:
+    explicit WorkerPool(unsigned threads);
+    ~WorkerPool();
+
+    void workerLoop();
+
+    /*! Run the ranges of the current parallelFor until none are left.  Called with the mutex locked.
+     *
+     */
+    void runRanges(std::unique_lock<std::mutex> &lock);
+
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake; // a parallelFor started, or the pool is stopping
+    std::condition_variable done; // the last range of a parallelFor finished
+    // state of the current parallelFor, guarded by mutex
+    const std::function<void(size_t, size_t)> *task = nullptr;
+    size_t count = 0;
+    size_t numRanges = 0;
+    size_t nextRange = 0;
+    size_t rangesLeft = 0;
+    uint64_t generation = 0; // incremented by each parallelFor, so workers wake up once for it
+    bool stopping = false;
+};
+
+#endif /* WORKER_POOL_H_ */
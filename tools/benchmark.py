@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+#
+# Run the block propagation benchmarks in simulations/benchmark.ini headless
+# and write a JSON summary with, for every run:
+#   - wall time, number of events and events per second
+#   - peak resident memory of the simulation process
+#   - time for each block to reach 50/90/99% of the nodes, from the
+#     blockReceived vectors recorded by POWNode
+#
+# usage: benchmark.py [-c CONFIG]... [-o summary.json]
+# run from anywhere; paths default to the layout of this repository.
+#
+
+import argparse
+import json
+import math
+import os
+import re
+import shlex
+import subprocess
+import sys
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PERCENTILES = [50, 90, 99]
+
+
+def run_numbers(args, config):
+    output = subprocess.run([args.sim, "-u", "Cmdenv", "-n", args.ned_path, "-f", args.ini, "-c", config, "-q", "runnumbers"],
+                            cwd=args.sim_dir, stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    lines = [line for line in output.splitlines() if re.match(r"^[\d ]+$", line.strip())]
+    return [int(n) for n in lines[-1].split()] if lines else []
+
+
+def run_simulation(args, config, run):
+    """Run one simulation, returning its wall time, event count and peak memory in kB."""
+    command = [args.sim, "-u", "Cmdenv", "-n", args.ned_path, "-f", args.ini, "-c", config, "-r", str(run)]
+    start = time.monotonic()
+    process = subprocess.Popen(command, cwd=args.sim_dir, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+                               universal_newlines=True)
+    output = process.stdout.read()
+    # wait4 gives the resource usage of this process alone (ru_maxrss is in kB on Linux)
+    _, status, usage = os.wait4(process.pid, 0)
+    wall_time = time.monotonic() - start
+    process.returncode = os.WEXITSTATUS(status) if os.WIFEXITED(status) else -1
+    if process.returncode != 0:
+        sys.stderr.write(output)
+        raise RuntimeError("%s run %d failed with exit code %d" % (config, run, process.returncode))
+    events = [int(n) for n in re.findall(r"[Ee]vent #(\d+)", output)]
+    return wall_time, events[-1] if events else None, usage.ru_maxrss
+
+
+def read_vectors(vec_file):
+    """Read the blockReceived vectors of a result file.
+    Returns the run's iteration variables, the number of nodes and a map of block hash to the times it was added by each node.
+    The number of nodes is the count parameter, or the number of nodes that recorded a block if it is not in the file."""
+    itervars = {}
+    count = None
+    vector_ids = set()
+    arrivals = {}
+    with open(vec_file) as reader:
+        for line in reader:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == "itervar":
+                # values such as miner lists are quoted and may contain spaces
+                fields = shlex.split(line)
+                itervars[fields[1]] = fields[2].strip('"')
+            elif fields[0] == "config" and fields[1].endswith(".count"):
+                count = int(fields[2])
+            elif fields[0] == "vector" and fields[3].startswith("blockReceived"):
+                vector_ids.add(fields[1])
+            elif fields[0] in vector_ids:
+                # vector id, event number, time, value
+                arrivals.setdefault(int(float(fields[3])), []).append(float(fields[2]))
+    return itervars, count if count is not None else max(len(vector_ids), 1), arrivals
+
+
+def propagation(arrivals, count):
+    """For each percentile, the mean and maximum time for a block to reach that fraction of nodes, over blocks that did."""
+    result = {}
+    for percentile in PERCENTILES:
+        needed = math.ceil(percentile / 100 * count)
+        delays = []
+        for times in arrivals.values():
+            times.sort()
+            if len(times) >= needed:
+                delays.append(times[needed - 1] - times[0])
+        result["p%d" % percentile] = {
+            "blocks": len(delays),
+            "mean": sum(delays) / len(delays) if delays else None,
+            "max": max(delays) if delays else None,
+        }
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run block propagation benchmarks and summarize them.")
+    parser.add_argument("-c", "--config", action="append", help="benchmark config to run (default Bench100)")
+    parser.add_argument("-o", "--output", default="benchmark_summary.json", help="JSON summary to write")
+    parser.add_argument("--sim", default=os.path.join(ROOT, "src", "p2p_sim"), help="simulation executable")
+    parser.add_argument("--sim-dir", default=os.path.join(ROOT, "simulations"), help="directory to run in")
+    parser.add_argument("--ini", default="benchmark.ini", help="ini file, relative to --sim-dir")
+    parser.add_argument("--ned-path", default=".:../src", help="NED path, relative to --sim-dir")
+    args = parser.parse_args()
+
+    summary = []
+    for config in args.config or ["Bench100"]:
+        for run in run_numbers(args, config):
+            print("running %s #%d" % (config, run), flush=True)
+            wall_time, events, peak_rss_kb = run_simulation(args, config, run)
+            itervars, count, arrivals = read_vectors(os.path.join(args.sim_dir, "results", "%s-%d.vec" % (config, run)))
+            summary.append({
+                "config": config,
+                "run": run,
+                "itervars": itervars,
+                "nodes": count,
+                "wallTime": wall_time,
+                "events": events,
+                "eventsPerSecond": events / wall_time if events and wall_time > 0 else None,
+                "peakRssKb": peak_rss_kb,
+                "blocks": len(arrivals),
+                "propagation": propagation(arrivals, count),
+            })
+            with open(args.output, "w") as writer:
+                json.dump(summary, writer, indent=2)
+    print("wrote %s" % args.output)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,33 @@
+#!/usr/bin/env python3
+#
+# Convert a text simulation schedule (see simulations/schedule.txt) into the
+# compact binary format read by POWScheduler (see src/schedule_reader.cpp).
+#
+# usage: schedule_to_binary.py schedule.txt schedule.bin
+#
+
+import struct
+import sys
+
+MAGIC = b"POWSCHED"
+# must match BINARY_EVENT_TYPES in src/schedule_reader.cpp
+EVENT_TYPES = ["schedulenewblock", "schedulenewtx", "schedulenodeleave", "schedulenodejoin"]
+
+
+def convert(text_file, binary_file):
+    with open(text_file) as reader, open(binary_file, "wb") as writer:
+        writer.write(MAGIC)
+        for line in reader:
+            tokens = line.split()
+            if not tokens:
+                continue
+            time, address, event_type = int(tokens[0]), int(tokens[1]), tokens[2]
+            parameters = [int(p) for p in tokens[3].split(",")] if len(tokens) > 3 else []
+            writer.write(struct.pack("=iiBB", time, address, EVENT_TYPES.index(event_type), len(parameters)))
+            writer.write(struct.pack("=%di" % len(parameters), *parameters))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) != 3:
+        sys.exit("usage: %s <text schedule> <binary schedule>" % sys.argv[0])
+    convert(sys.argv[1], sys.argv[2])
@@ -0,0 +1,148 @@
+#!/usr/bin/env python3
+#
+# Run every run of a parameter sweep config (see [Config Sweep] in
+# simulations/omnetpp.ini) as independent Cmdenv processes, several at a time,
+# then merge the scalars of all runs into one CSV table with a row per run and
+# scalar name, summarized over the modules that recorded it.
+#
+# usage: sweep.py [-c CONFIG] [-j JOBS] [--timeout SECONDS] [--resume] [-o summary.csv]
+#
+# The state of every run is kept in <config>_status.json next to the results,
+# so an interrupted or partly failed sweep can be continued with --resume,
+# which only runs what has not finished yet.
+#
+
+import argparse
+import csv
+import json
+import os
+import re
+import shlex
+import subprocess
+import sys
+import threading
+import time
+from concurrent.futures import ThreadPoolExecutor
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+
+def run_numbers(args):
+    output = subprocess.run([args.sim, "-u", "Cmdenv", "-n", args.ned_path, "-f", args.ini, "-c", args.config, "-q", "runnumbers"],
+                            cwd=args.sim_dir, stdout=subprocess.PIPE, universal_newlines=True, check=True).stdout
+    lines = [line for line in output.splitlines() if re.match(r"^[\d ]+$", line.strip())]
+    return [int(n) for n in lines[-1].split()] if lines else []
+
+
+def run_simulation(args, run):
+    """Run one simulation, returning its status (done, failed or timeout) and wall time.
+    The output of the run goes to results/<config>-<run>.log."""
+    command = [args.sim, "-u", "Cmdenv", "-n", args.ned_path, "-f", args.ini, "-c", args.config, "-r", str(run)]
+    log_file = os.path.join(args.results_dir, "%s-%d.log" % (args.config, run))
+    start = time.monotonic()
+    with open(log_file, "w") as log:
+        try:
+            process = subprocess.run(command, cwd=args.sim_dir, stdout=log, stderr=subprocess.STDOUT,
+                                     timeout=args.timeout)
+            status = "done" if process.returncode == 0 else "failed"
+        except subprocess.TimeoutExpired:
+            status = "timeout"
+    return status, time.monotonic() - start
+
+
+def read_scalars(sca_file):
+    """Read the iteration variables and scalars of a result file.
+    Statistics are read as one scalar per field, named <statistic>:<field>.
+    Returns the iteration variables and a map of scalar name to the values recorded by each module."""
+    itervars = {}
+    scalars = {}
+    statistic = None
+    with open(sca_file) as reader:
+        for line in reader:
+            fields = line.split()
+            if not fields:
+                continue
+            if fields[0] == "itervar":
+                # values such as miner lists are quoted and may contain spaces
+                fields = shlex.split(line)
+                itervars[fields[1]] = fields[2].strip('"')
+            elif fields[0] == "scalar":
+                # scalar module name value
+                scalars.setdefault(fields[2], []).append(float(fields[3]))
+            elif fields[0] == "statistic":
+                statistic = fields[2]
+            elif fields[0] == "field" and statistic:
+                scalars.setdefault("%s:%s" % (statistic, fields[1]), []).append(float(fields[2]))
+    return itervars, scalars
+
+
+def merge_results(args, runs, status):
+    """Write the summary table of every finished run."""
+    rows = []
+    itervar_names = []
+    for run in runs:
+        if status.get(str(run), {}).get("status") != "done":
+            continue
+        itervars, scalars = read_scalars(os.path.join(args.results_dir, "%s-%d.sca" % (args.config, run)))
+        for name in itervars:
+            if name not in itervar_names:
+                itervar_names.append(name)
+        for name, values in sorted(scalars.items()):
+            rows.append(dict(itervars, run=run, scalar=name, modules=len(values), sum=sum(values),
+                             mean=sum(values) / len(values), min=min(values), max=max(values)))
+    with open(args.output, "w", newline="") as writer:
+        table = csv.DictWriter(writer, ["run"] + itervar_names + ["scalar", "modules", "sum", "mean", "min", "max"])
+        table.writeheader()
+        table.writerows(rows)
+    return len(rows)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run a parameter sweep in parallel and merge its scalar results.")
+    parser.add_argument("-c", "--config", default="Sweep", help="config to run every run of (default Sweep)")
+    parser.add_argument("-j", "--jobs", type=int, default=os.cpu_count(), help="number of runs at a time (default: number of cores)")
+    parser.add_argument("--timeout", type=float, help="seconds before a run is killed and marked as timed out")
+    parser.add_argument("--resume", action="store_true", help="skip runs that finished in an earlier invocation")
+    parser.add_argument("-o", "--output", help="summary table to write (default <config>_summary.csv)")
+    parser.add_argument("--sim", default=os.path.join(ROOT, "src", "p2p_sim"), help="simulation executable")
+    parser.add_argument("--sim-dir", default=os.path.join(ROOT, "simulations"), help="directory to run in")
+    parser.add_argument("--ini", default="omnetpp.ini", help="ini file, relative to --sim-dir")
+    parser.add_argument("--ned-path", default=".:../src", help="NED path, relative to --sim-dir")
+    args = parser.parse_args()
+    args.results_dir = os.path.join(args.sim_dir, "results")
+    args.output = args.output or "%s_summary.csv" % args.config
+    os.makedirs(args.results_dir, exist_ok=True)
+
+    status_file = os.path.join(args.results_dir, "%s_status.json" % args.config)
+    status = {}
+    if args.resume and os.path.exists(status_file):
+        with open(status_file) as reader:
+            status = json.load(reader)
+    runs = run_numbers(args)
+    pending = [run for run in runs if status.get(str(run), {}).get("status") != "done"]
+    print("%s: %d runs, %d to do, %d at a time" % (args.config, len(runs), len(pending), args.jobs), flush=True)
+
+    lock = threading.Lock()
+
+    def job(run):
+        result, wall_time = run_simulation(args, run)
+        with lock:
+            status[str(run)] = {"status": result, "wallTime": wall_time}
+            # saved after every run, so a killed sweep can still be resumed
+            with open(status_file, "w") as writer:
+                json.dump(status, writer, indent=2)
+            print("%s #%d %s in %.1fs" % (args.config, run, result, wall_time), flush=True)
+
+    with ThreadPoolExecutor(max_workers=max(args.jobs, 1)) as pool:
+        list(pool.map(job, pending))
+
+    failed = [run for run in runs if status.get(str(run), {}).get("status") != "done"]
+    rows = merge_results(args, runs, status)
+    print("wrote %d rows to %s" % (rows, args.output))
+    if failed:
+        print("%d runs did not finish: %s.  rerun with --resume to retry them" % (len(failed), " ".join(map(str, failed))))
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()